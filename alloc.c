@@ -1,16 +1,957 @@
+/* for MAP_ANONYMOUS and friends when compiling with a strict -std=, and for mremap */
+#define _GNU_SOURCE
+
 #include "alloc.h"
+#include "pat_kernels.h"
 
 /* implementation using stdlib: */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ALLOC_HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#include "alloc_clock.h"
+#define ALLOC_HAVE_PTHREADS
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#endif
+
+
+/* number of pages summarized by one leaf of the free-run index, i.e. one 64 bit word of the PAT */
+#define PAGES_PER_BLOCK PAT_PAGES_PER_WORD
+
+typedef struct free_run_node {
+    uint32_t prefix;  /* free pages at the start of the node's range */
+    uint32_t suffix;  /* free pages at the end of the node's range */
+    uint32_t longest; /* longest free run fully inside the node's range */
+} free_run_node;
+
+/* free runs of lengths [2**c, 2**(c+1)) form class c, the last class also takes all longer runs */
+#define RUN_CLASSES 20
+
+/* for PLACEMENT_BEST_FIT and PLACEMENT_SEGREGATED_FIT: the start pages of the maximal free runs, one bitmap per
+   class so that runs are found in address order, with a summary bit per bitmap word to skip empty stretches.
+   Every maximal free run [s, e) also carries its length as boundary tags in run_pages[s] and run_pages[e-1]
+   (those pages are free, so the tags don't collide with the lengths of allocations), which makes merging
+   with the neighbouring runs on release O(1) */
+struct free_run_classes {
+    uint32_t words;                  /* 64 bit words in each starts bitmap */
+    uint64_t *starts[RUN_CLASSES];
+    uint64_t *summary[RUN_CLASSES];  /* bit w set iff starts[c][w] != 0 */
+};
+
+struct free_run_index {
+    uint32_t leaf_count;   /* power of two, each leaf covers PAGES_PER_BLOCK pages */
+    free_run_node *nodes;  /* implicit tree: nodes[1] is the root, node k has children 2k and 2k+1, leaves start at leaf_count */
+    uint32_t cursor;       /* PLACEMENT_NEXT_FIT: the page the next search starts at */
+    struct free_run_classes *classes;  /* NULL unless the placement needs them */
+};
+
+static inline int page_state(const uint8_t *PAT, uint32_t i) {
+    return (PAT[i/4] >> (i%4)*2) & 0x3;
+}
+
+/* the PAT is padded to whole 64 bit words for the kernels, the padding pages are marked 11 so they never look free */
+static size_t PAT_bytes(uint32_t page_number) {
+    return (((size_t) page_number + PAT_PAGES_PER_WORD - 1) / PAT_PAGES_PER_WORD) * 8;
+}
+
+#ifdef ALLOC_TRACE
+#ifndef ALLOC_HAVE_MMAP
+#error "ALLOC_TRACE needs clock_gettime and C11 atomics"
+#endif
+
+/* a slot's sequence is 2n+1 while record number n is written into it and 2n+2 once that is complete, so readers
+   can tell complete records from torn and overwritten ones without locking out the writers; the record is copied
+   in and out word by word with relaxed atomics, as a reader may copy it while a writer overwrites it */
+#define TRACE_RECORD_WORDS (sizeof(alloc_trace_record) / 8)
+_Static_assert(sizeof(alloc_trace_record) % 8 == 0, "trace records are copied as whole 64 bit words");
+struct alloc_trace_slot {
+    _Atomic uint64_t sequence;
+    _Atomic uint64_t record[TRACE_RECORD_WORDS];
+};
+
+struct alloc_trace {
+    _Atomic uint64_t next;  /* number of the next record to be written */
+    struct alloc_trace_slot slots[ALLOC_TRACE_RECORDS];
+};
+
+static _Thread_local uint32_t trace_scanned;  /* PAT pages read by the search of this thread's current call */
+
+static void start_trace(allocator* p_alloc) {
+    p_alloc[0].trace = calloc(1,sizeof(struct alloc_trace));
+    if(p_alloc[0].trace == NULL && p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Ran out of system memory for the trace records, tracing is off");
+}
+
+static uint64_t trace_begin(void) {
+    trace_scanned = 0;
+    return monotonic_ns();
+}
+
+/* first page of the allocation ptr points to, UINT32_MAX if it doesn't point to one */
+static uint32_t trace_page(const allocator* p_alloc, const void* ptr) {
+    if(p_alloc == NULL || ptr == NULL || (const uint8_t*) ptr < p_alloc[0].data) return UINT32_MAX;
+    size_t offset = (size_t) ((const uint8_t*) ptr - p_alloc[0].data);
+    if(offset % p_alloc[0].page_size != 0 || offset / p_alloc[0].page_size >= p_alloc[0].allocated_pages) return UINT32_MAX;
+    uint32_t page = (uint32_t) (offset / p_alloc[0].page_size);
+    return (page_state(p_alloc[0].PAT, page) == 0x02) ? page : UINT32_MAX;
+}
+
+static uint32_t trace_pages(const allocator* p_alloc, uint32_t page) {
+    return (page != UINT32_MAX) ? p_alloc[0].run_pages[page] : 0;
+}
+
+static void trace_record(const allocator* p_alloc, alloc_trace_op op, uint64_t start, alloc_result result, size_t size, int alignment_bits, bool zeroed, uint32_t old_page, uint32_t old_pages, uint32_t page, uint32_t pages) {
+    if(p_alloc == NULL || p_alloc[0].trace == NULL) return;
+    uint64_t duration = monotonic_ns() - start;
+    alloc_trace_record record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp_ns = start;
+    record.duration_ns = duration;
+    record.size = size;
+    record.page = page;
+    record.pages = pages;
+    record.old_page = old_page;
+    record.old_pages = old_pages;
+    record.pages_scanned = trace_scanned;
+    record.op = (uint8_t) op;
+    record.result = (uint8_t) result;
+    record.alignment_bits = (uint8_t) alignment_bits;
+    record.zeroed = zeroed;
+    uint64_t words[TRACE_RECORD_WORDS];
+    memcpy(words, &record, sizeof(record));
+    
+    struct alloc_trace *trace = p_alloc[0].trace;
+    uint64_t n = atomic_fetch_add_explicit(&(trace->next), 1, memory_order_relaxed);
+    struct alloc_trace_slot *slot = &(trace->slots[n & (ALLOC_TRACE_RECORDS - 1)]);
+    atomic_store_explicit(&(slot->sequence), 2*n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for(size_t w = 0; w < TRACE_RECORD_WORDS; w++) atomic_store_explicit(&(slot->record[w]), words[w], memory_order_relaxed);
+    atomic_store_explicit(&(slot->sequence), 2*n + 2, memory_order_release);
+}
+
+/* reads the PAT for the new allocation, so the caller holds the lock */
+static void trace_end(const allocator* p_alloc, alloc_trace_op op, uint64_t start, alloc_result result, size_t size, int alignment_bits, bool zeroed, uint32_t old_page, uint32_t old_pages, const void* new_ptr) {
+    if(p_alloc == NULL || p_alloc[0].trace == NULL) return;
+    uint32_t page = (result == SUCCESS) ? trace_page(p_alloc, new_ptr) : UINT32_MAX;
+    trace_record(p_alloc, op, start, result, size, alignment_bits, zeroed, old_page, old_pages, page, trace_pages(p_alloc, page));
+}
+
+/* TRACE_BEGIN notes the time and the allocation ptr points to (NULL for none) at the start of a call, TRACE_END
+   writes its record; both go in the same block, after the lock is taken. TRACE_TAKEN records an allocation served
+   from a thread cache, whose pages are known without reading the PAT */
+#define TRACE_BEGIN(p_alloc, ptr) \
+    uint64_t trace_start = trace_begin(); \
+    uint32_t trace_old_page = trace_page(p_alloc, ptr); \
+    uint32_t trace_old_pages = trace_pages(p_alloc, trace_old_page); \
+    (void) trace_old_pages
+#define TRACE_END(p_alloc, op, result, size, alignment_bits, zeroed, new_ptr) \
+    trace_end(p_alloc, op, trace_start, result, size, alignment_bits, zeroed, trace_old_page, trace_old_pages, new_ptr)
+#define TRACE_FREED(p_alloc, page, pages) trace_end(p_alloc, TRACE_FREE, trace_start, SUCCESS, 0, 0, false, page, pages, NULL)
+#define TRACE_TAKEN(p_alloc, size, alignment_bits, zeroed, page, pages) \
+    trace_record(p_alloc, TRACE_ALLOC, trace_start, SUCCESS, size, alignment_bits, zeroed, UINT32_MAX, 0, page, pages)
+#define TRACE_SCAN(pages) (trace_scanned += (uint32_t) (pages))
+#else
+#define start_trace(p_alloc) ((void) 0)
+#define TRACE_BEGIN(p_alloc, ptr)
+#define TRACE_END(p_alloc, op, result, size, alignment_bits, zeroed, new_ptr) ((void) 0)
+#define TRACE_FREED(p_alloc, page, pages) ((void) 0)
+#define TRACE_TAKEN(p_alloc, size, alignment_bits, zeroed, page, pages) ((void) 0)
+#define TRACE_SCAN(pages) ((void) 0)
+#endif
+
+static inline uint32_t lowest_bit(uint64_t value) {
+#ifdef __GNUC__
+    return (uint32_t) __builtin_ctzll(value);
+#else
+    uint32_t position = 0;
+    while((value & 1) == 0) {
+        value >>= 1;
+        position++;
+    }
+    return position;
+#endif
+}
+
+static int run_class(uint32_t length) {
+    int c = 0;
+    while(c + 1 < RUN_CLASSES && (length >> (c + 1)) != 0) c++;
+    return c;
+}
+
+static void insert_free_run(const allocator* p_alloc, uint32_t start, uint32_t length) {
+    struct free_run_classes *classes = p_alloc[0].free_runs->classes;
+    int c = run_class(length);
+    classes->starts[c][start / 64] |= (uint64_t) 1 << (start % 64);
+    classes->summary[c][start / 4096] |= (uint64_t) 1 << ((start / 64) % 64);
+    p_alloc[0].run_pages[start] = length;
+    p_alloc[0].run_pages[start + length - 1] = length;
+}
+
+static void remove_free_run(const allocator* p_alloc, uint32_t start, uint32_t length) {
+    struct free_run_classes *classes = p_alloc[0].free_runs->classes;
+    int c = run_class(length);
+    classes->starts[c][start / 64] &= ~((uint64_t) 1 << (start % 64));
+    if(classes->starts[c][start / 64] == 0) classes->summary[c][start / 4096] &= ~((uint64_t) 1 << ((start / 64) % 64));
+}
+
+/* the first run start of class c at or after page from, or UINT32_MAX if there is none */
+static uint32_t next_run_start(const struct free_run_classes *classes, int c, uint32_t from) {
+    size_t word = from / 64;
+    if(word >= classes->words) return UINT32_MAX;
+    uint64_t bits = classes->starts[c][word] & (~0ULL << (from % 64));
+    if(bits != 0) return (uint32_t) (word*64 + lowest_bit(bits));
+    size_t summary_words = (classes->words + 63) / 64;
+    size_t next = word + 1;
+    for(size_t s = next / 64; s < summary_words; s++) {
+        uint64_t summary = classes->summary[c][s];
+        if(s == next / 64) summary &= ~0ULL << (next % 64);
+        if(summary != 0) {
+            size_t found = s*64 + lowest_bit(summary);
+            return (uint32_t) (found*64 + lowest_bit(classes->starts[c][found]));
+        }
+    }
+    return UINT32_MAX;
+}
+
+/* pages [first, last) of the free run around them are about to be claimed: the run makes way for what remains of it */
+static void classes_claim(const allocator* p_alloc, uint32_t first, uint32_t last) {
+    if(p_alloc[0].free_runs->classes == NULL) return;
+    uint32_t start = first - (uint32_t) pat_free_run_before(p_alloc[0].PAT, first);
+    uint32_t end = start + p_alloc[0].run_pages[start];
+    remove_free_run(p_alloc, start, end - start);
+    if(start < first) insert_free_run(p_alloc, start, first - start);
+    if(last < end) insert_free_run(p_alloc, last, end - last);
+}
+
+/* the allocated pages [first, last) are released: they merge with the free runs on either side */
+static void classes_release(const allocator* p_alloc, uint32_t first, uint32_t last) {
+    if(p_alloc[0].free_runs->classes == NULL) return;
+    uint32_t start = first, end = last;
+    if(first > 0 && pat_page_is(p_alloc[0].PAT, first - 1, PAT_FREE)) {
+        uint32_t left_length = p_alloc[0].run_pages[first - 1];
+        start = first - left_length;
+        remove_free_run(p_alloc, start, left_length);
+    }
+    if(last < p_alloc[0].allocated_pages && pat_page_is(p_alloc[0].PAT, last, PAT_FREE)) {
+        uint32_t right_length = p_alloc[0].run_pages[last];
+        end = last + right_length;
+        remove_free_run(p_alloc, last, right_length);
+    }
+    insert_free_run(p_alloc, start, end - start);
+}
+
+static alloc_result build_run_classes(const allocator* p_alloc) {
+    struct free_run_index *index = p_alloc[0].free_runs;
+    if(p_alloc[0].placement != PLACEMENT_BEST_FIT && p_alloc[0].placement != PLACEMENT_SEGREGATED_FIT) return SUCCESS;
+    if(index->classes == NULL) {
+        index->classes = calloc(1, sizeof(struct free_run_classes));
+        if(index->classes == NULL) return OUT_OF_MEMORY;
+    }
+    struct free_run_classes *classes = index->classes;
+    uint32_t words = (p_alloc[0].allocated_pages + 63) / 64 + 1;
+    size_t summary_words = (words + 63) / 64;
+    for(int c = 0; c < RUN_CLASSES; c++) {
+        if(words != classes->words || classes->starts[c] == NULL) {
+            uint64_t *new_starts = realloc(classes->starts[c], words*sizeof(uint64_t));
+            if(new_starts == NULL) return OUT_OF_MEMORY;
+            classes->starts[c] = new_starts;
+            uint64_t *new_summary = realloc(classes->summary[c], summary_words*sizeof(uint64_t));
+            if(new_summary == NULL) return OUT_OF_MEMORY;
+            classes->summary[c] = new_summary;
+        }
+        memset(classes->starts[c], 0, words*sizeof(uint64_t));
+        memset(classes->summary[c], 0, summary_words*sizeof(uint64_t));
+    }
+    classes->words = words;
+    
+    size_t run_start = pat_find_page(p_alloc[0].PAT, 0, p_alloc[0].allocated_pages, PAT_FREE);
+    while(run_start < p_alloc[0].allocated_pages) {
+        size_t run_length = pat_extend_run(p_alloc[0].PAT, run_start, p_alloc[0].allocated_pages, PAT_FREE);
+        insert_free_run(p_alloc, (uint32_t) run_start, (uint32_t) run_length);
+        run_start = pat_find_page(p_alloc[0].PAT, run_start + run_length, p_alloc[0].allocated_pages, PAT_FREE);
+    }
+    return SUCCESS;
+}
+
+static void free_run_index_destroy(struct free_run_index *index) {
+    if(index == NULL) return;
+    if(index->classes != NULL) {
+        for(int c = 0; c < RUN_CLASSES; c++) {
+            free(index->classes->starts[c]);
+            free(index->classes->summary[c]);
+        }
+        free(index->classes);
+    }
+    free(index->nodes);
+    free(index);
+}
+
+static free_run_node summarize_block(const allocator* p_alloc, uint32_t block) {
+    free_run_node leaf;
+    if((size_t) block*8 >= PAT_bytes(p_alloc[0].allocated_pages)) {
+        leaf.prefix = leaf.suffix = leaf.longest = 0;
+        return leaf;
+    }
+    pat_summarize_word(p_alloc[0].PAT, block, &leaf.prefix, &leaf.suffix, &leaf.longest);
+    return leaf;
+}
+
+static free_run_node combine_nodes(free_run_node left, free_run_node right, uint32_t half_length) {
+    free_run_node parent;
+    parent.prefix = (left.prefix == half_length) ? half_length + right.prefix : left.prefix;
+    parent.suffix = (right.suffix == half_length) ? half_length + left.suffix : right.suffix;
+    parent.longest = left.suffix + right.prefix;
+    if(left.longest > parent.longest) parent.longest = left.longest;
+    if(right.longest > parent.longest) parent.longest = right.longest;
+    return parent;
+}
+
+/* recomputes the leaves covering pages [first, last) and every node above them */
+static void update_free_run_index(const allocator* p_alloc, uint32_t first, uint32_t last) {
+    struct free_run_index *index = p_alloc[0].free_runs;
+    if(first >= last) return;
+    uint32_t low = index->leaf_count + first/PAGES_PER_BLOCK;
+    uint32_t high = index->leaf_count + (last-1)/PAGES_PER_BLOCK;
+    for(uint32_t k = low; k <= high; k++) {
+        index->nodes[k] = summarize_block(p_alloc, k - index->leaf_count);
+    }
+    uint32_t half_length = PAGES_PER_BLOCK;
+    while(low > 1) {
+        low /= 2;
+        high /= 2;
+        for(uint32_t k = low; k <= high; k++) {
+            index->nodes[k] = combine_nodes(index->nodes[2*k], index->nodes[2*k+1], half_length);
+        }
+        half_length *= 2;
+    }
+}
+
+static alloc_result build_free_run_index(const allocator* p_alloc) {
+    struct free_run_index *index = p_alloc[0].free_runs;
+    uint32_t blocks = (p_alloc[0].allocated_pages + PAGES_PER_BLOCK - 1) / PAGES_PER_BLOCK;
+    uint32_t leaf_count = 1;
+    while(leaf_count < blocks) leaf_count *= 2;
+    
+    if(leaf_count != index->leaf_count || index->nodes == NULL) {
+        free_run_node *new_nodes = realloc(index->nodes, 2*leaf_count*sizeof(free_run_node));
+        if(new_nodes == NULL) return OUT_OF_MEMORY;
+        index->nodes = new_nodes;
+        index->leaf_count = leaf_count;
+    }
+    /* padding leaves behind the last block have no pages and thus no free runs */
+    memset(index->nodes, 0, 2*leaf_count*sizeof(free_run_node));
+    update_free_run_index(p_alloc, 0, leaf_count*PAGES_PER_BLOCK);
+    return build_run_classes(p_alloc);
+}
+
+/* first fit search below node k, which covers the pages [start, start+length) and must contain a fitting run */
+static bool descend_free_run(const allocator* p_alloc, uint32_t k, uint32_t start, uint32_t length, uint32_t used_pages, uint32_t *out_index) {
+    const struct free_run_index *index = p_alloc[0].free_runs;
+    while(k < index->leaf_count) {
+        uint32_t half_length = length/2;
+        const free_run_node *left = &(index->nodes[2*k]);
+        const free_run_node *right = &(index->nodes[2*k+1]);
+        if(left->longest >= used_pages) {
+            k = 2*k;
+        } else if(left->suffix + right->prefix >= used_pages) {
+            out_index[0] = start + half_length - left->suffix;
+            return true;
+        } else {
+            k = 2*k+1;
+            start += half_length;
+        }
+        length = half_length;
+    }
+    
+    /* the run lies completely within this leaf's block */
+    size_t run_start;
+    TRACE_SCAN(PAGES_PER_BLOCK);
+    if(!pat_find_free_run(p_alloc[0].PAT, start, start + PAGES_PER_BLOCK, used_pages, &run_start)) return false;
+    out_index[0] = run_start;
+    return true;
+}
+
+/* first fit search on the index; returns false if no free run of used_pages pages exists */
+static bool find_free_run(const allocator* p_alloc, uint32_t used_pages, uint32_t *out_index) {
+    const struct free_run_index *index = p_alloc[0].free_runs;
+    if(used_pages == 0 || index->nodes[1].longest < used_pages) return false;
+    return descend_free_run(p_alloc, 1, 0, index->leaf_count*PAGES_PER_BLOCK, used_pages, out_index);
+}
+
+/* first fit among the pages from 'from' on, with the pages before it taken as used; carry holds the free pages
+   (at or after from) that directly precede node k, which covers [start, start+length) */
+static bool find_free_run_from(const allocator* p_alloc, uint32_t k, uint32_t start, uint32_t length, uint32_t from, uint32_t used_pages, uint32_t *carry, uint32_t *out_index) {
+    const struct free_run_index *index = p_alloc[0].free_runs;
+    if(start + length <= from) return false;
+    const free_run_node *node = &(index->nodes[k]);
+    if(start >= from) {
+        if(carry[0] + node->prefix >= used_pages) {
+            out_index[0] = start - carry[0];
+            return true;
+        }
+        if(node->longest >= used_pages) return descend_free_run(p_alloc, k, start, length, used_pages, out_index);
+        carry[0] = (node->prefix == length) ? carry[0] + length : node->suffix;
+        return false;
+    }
+    if(k >= index->leaf_count) {
+        size_t run_start;
+        TRACE_SCAN(start + length - from);
+        if(pat_find_free_run(p_alloc[0].PAT, from, start + length, used_pages, &run_start)) {
+            out_index[0] = run_start;
+            return true;
+        }
+        carry[0] = (node->suffix < start + length - from) ? node->suffix : start + length - from;
+        return false;
+    }
+    return find_free_run_from(p_alloc, 2*k, start, length/2, from, used_pages, carry, out_index)
+        || find_free_run_from(p_alloc, 2*k+1, start + length/2, length/2, from, used_pages, carry, out_index);
+}
+
+/* best and segregated fit on the run classes, see allocator_placement */
+static bool find_classed_run(const allocator* p_alloc, uint32_t used_pages, bool best, uint32_t *out_index) {
+    const struct free_run_classes *classes = p_alloc[0].free_runs->classes;
+    for(int c = run_class(used_pages); c < RUN_CLASSES; c++) {
+        uint32_t found = UINT32_MAX;
+        uint32_t found_length = UINT32_MAX;
+        for(uint32_t start = next_run_start(classes, c, 0); start != UINT32_MAX; start = next_run_start(classes, c, start + 1)) {
+            uint32_t length = p_alloc[0].run_pages[start];
+            if(length < used_pages || length >= found_length) continue;
+            found = start;
+            found_length = length;
+            if(!best || length == used_pages) break;
+        }
+        /* every run of a higher class is longer than those of this one */
+        if(found != UINT32_MAX) {
+            out_index[0] = found;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* the first position at or after page from where used_pages free pages start */
+static bool find_free_run_after(const allocator* p_alloc, uint32_t used_pages, uint32_t from, uint32_t *out_index) {
+    const struct free_run_index *index = p_alloc[0].free_runs;
+    if(used_pages == 0 || index->nodes[1].longest < used_pages) return false;
+    uint32_t carry = 0;
+    return find_free_run_from(p_alloc, 1, 0, index->leaf_count*PAGES_PER_BLOCK, from, used_pages, &carry, out_index);
+}
+
+/* places an unaligned allocation of used_pages pages according to the allocator's placement policy */
+static bool find_placement(const allocator* p_alloc, uint32_t used_pages, uint32_t *out_index) {
+    struct free_run_index *index = p_alloc[0].free_runs;
+    switch(p_alloc[0].placement) {
+        case PLACEMENT_NEXT_FIT: {
+            if(find_free_run_after(p_alloc, used_pages, index->cursor, out_index) || find_free_run(p_alloc, used_pages, out_index)) {
+                index->cursor = out_index[0] + used_pages;
+                return true;
+            }
+            return false;
+        }
+        case PLACEMENT_BEST_FIT:
+            return find_classed_run(p_alloc, used_pages, true, out_index);
+        case PLACEMENT_SEGREGATED_FIT:
+            return find_classed_run(p_alloc, used_pages, false, out_index);
+        case PLACEMENT_FIRST_FIT:
+        default:
+            return find_free_run(p_alloc, used_pages, out_index);
+    }
+}
+
+/* the 01 pages are counted on every change of the PAT, which tells purging when to start. Purging in the background
+   of the allocation functions goes in steps of at most PURGE_STEP_BYTES, each continuing the sweep over the PAT where
+   the last one stopped, until the 01 pages are down to the goal or the sweep has gone once around the PAT */
+#define PURGE_STEP_BYTES ((size_t) 2 << 20)
+#define PURGE_CLOCK_CALLS 64  /* the decay deadline is checked on every PURGE_CLOCK_CALLS-th call only */
+#define PURGE_IDLE UINT64_MAX
+
+struct allocator_purge {
+    uint64_t dirty_pages;      /* 01 pages */
+    uint64_t watermark_pages;  /* from the options, 0 for none */
+    uint64_t decay_ns;         /* from the options, 0 for none */
+    uint64_t deadline_ns;      /* when the oldest 01 page has been free for decay_ns, 0 while there are none */
+    uint64_t rearm_pages;      /* after a sweep that couldn't reach its goal, the watermark only triggers above this */
+    uint64_t goal;             /* the 01 page count the ongoing purge stops at, PURGE_IDLE if none is under way */
+    uint64_t swept_pages;      /* pages passed by the ongoing purge */
+    uint32_t cursor;           /* the page the next purge step continues at */
+    uint32_t calls;
+};
+
+
+static void count_dirty_pages(const allocator* p_alloc, uint64_t pages) {
+    struct allocator_purge *purge = p_alloc[0].purge;
+    if(pages == 0) return;
+#ifdef ALLOC_HAVE_MMAP
+    if(purge->dirty_pages == 0 && purge->decay_ns != 0) purge->deadline_ns = monotonic_ns() + purge->decay_ns;
+#endif
+    purge->dirty_pages += pages;
+}
+
+static void uncount_dirty_pages(const allocator* p_alloc, uint64_t pages) {
+    struct allocator_purge *purge = p_alloc[0].purge;
+    purge->dirty_pages -= pages;
+    if(purge->dirty_pages == 0) purge->deadline_ns = 0;
+}
+
+/* the 10 and 11 pages are counted along with the 01 ones, the 00 pages are what is left; ALLOC_NO_STATS compiles
+   this counting out, including the evaluation of the arguments */
+#ifndef ALLOC_NO_STATS
+static void count_used_pages(const allocator* p_alloc, int64_t allocations, int64_t pages) {
+    allocator_stats *stats = p_alloc[0].stats;
+    stats->live_allocations += (uint64_t) allocations;
+    stats->used_pages += (uint64_t) pages;
+    if(stats->used_pages > stats->peak_used_pages) stats->peak_used_pages = stats->used_pages;
+}
+
+/* the allocations starting in [first, last), which is either the tail of one allocation or a row of whole ones */
+static uint32_t allocations_in(const allocator* p_alloc, uint32_t first, uint32_t last) {
+    uint32_t allocations = 0;
+    for(uint32_t i = first; i < last && page_state(p_alloc[0].PAT, i) == 0x02; i += p_alloc[0].run_pages[i]) allocations++;
+    return allocations;
+}
+
+#define COUNT_USED_PAGES(p_alloc, allocations, pages) count_used_pages(p_alloc, allocations, pages)
+#define COUNT_REQUESTS(stats, count, size, rounded_size) \
+    ((stats)->allocations_made += (count), (stats)->bytes_requested += (uint64_t) (count)*(size), (stats)->bytes_rounded += (uint64_t) (count)*(rounded_size))
+#define COUNT_RESIZE_BYTES(stats, copied, remapped) ((stats)->resize_bytes_copied += (copied), (stats)->resize_bytes_remapped += (remapped))
+#else
+#define COUNT_USED_PAGES(p_alloc, allocations, pages) ((void) 0)
+#define COUNT_REQUESTS(stats, count, size, rounded_size) ((void) sizeof(size))
+#define COUNT_RESIZE_BYTES(stats, copied, remapped) ((void) 0)
+#endif
+
+#ifdef ALLOC_HAVE_MMAP
+static size_t os_page_size(void) {
+    return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/* bytes of the data array for page_number pages, rounded up to whole units of commit_bytes */
+static size_t os_page_bytes(const allocator* p_alloc, uint32_t page_number) {
+    size_t bytes = (size_t) page_number * p_alloc[0].page_size;
+    return ((bytes + p_alloc[0].commit_bytes - 1) / p_alloc[0].commit_bytes) * p_alloc[0].commit_bytes;
+}
+
+/* gives the whole commit units inside the pages [first, last) back to the kernel, which zeroes them,
+   and returns the range of pages that are now known to be zero in out_first and out_last */
+static bool discard_pages(const allocator* p_alloc, uint32_t first, uint32_t last, uint32_t *out_first, uint32_t *out_last) {
+    size_t unit = p_alloc[0].commit_bytes;
+    size_t begin = (size_t) first * p_alloc[0].page_size;
+    size_t end = (size_t) last * p_alloc[0].page_size;
+    begin = ((begin + unit - 1) / unit) * unit;
+    end = (end / unit) * unit;
+    if(begin >= end) return false;
+    /* MADV_DONTNEED on a shared mapping would only drop this process's view of the pages, not zero them */
+    int advice = MADV_DONTNEED;
+    if(p_alloc[0].backend == BACKEND_SHARED) {
+#ifdef MADV_REMOVE
+        advice = MADV_REMOVE;
+#else
+        return false;
+#endif
+    }
+    if(madvise(&(p_alloc[0].data[begin]), end - begin, advice) != 0) return false;
+    out_first[0] = (begin + p_alloc[0].page_size - 1) / p_alloc[0].page_size;
+    out_last[0] = end / p_alloc[0].page_size;
+    return out_first[0] < out_last[0];
+}
+
+/* reads the first number after key in a file of the kernel, 0 if there is none */
+static size_t read_kernel_number(const char* path, const char* key) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) return 0;
+    char line[256];
+    size_t number = 0;
+    while(number == 0 && fgets(line, sizeof(line), file) != NULL) {
+        char *found = strstr(line, key);
+        if(found != NULL) number = strtoull(found + strlen(key), NULL, 10);
+    }
+    fclose(file);
+    return number;
+}
+
+/* the size of the huge pages of the given kind, 0 if the system has none */
+static size_t huge_page_size(allocator_huge_pages kind) {
+    size_t hugetlb_bytes = read_kernel_number("/proc/meminfo", "Hugepagesize:") * 1024;
+    size_t transparent_bytes = read_kernel_number("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "");
+    if(kind == HUGE_PAGES_HUGETLB && hugetlb_bytes != 0) return hugetlb_bytes;
+    return (transparent_bytes != 0) ? transparent_bytes : hugetlb_bytes;
+}
+
+/* marks the reserved range for transparent huge pages, unless the kernel doesn't do them (for this range) */
+static bool advise_huge_pages(const allocator* p_alloc) {
+#ifdef MADV_HUGEPAGE
+    FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if(file != NULL) {
+        char line[256];
+        bool disabled = (fgets(line, sizeof(line), file) == NULL || strstr(line, "[never]") != NULL);
+        fclose(file);
+        if(disabled) return false;
+    }
+    return madvise(p_alloc[0].data, os_page_bytes(p_alloc, p_alloc[0].reserved_pages), MADV_HUGEPAGE) == 0;
+#else
+    (void) p_alloc;
+    return false;
+#endif
+}
+
+/* makes the bytes [begin, end) of the reserved range usable. Under HUGE_PAGES_HUGETLB they are mapped from the
+   huge page pool, which fails right away if the pool is short of pages (rather than on first touch); then the
+   allocator falls back to transparent huge pages for these and all further pages */
+static bool commit_data(allocator* p_alloc, size_t begin, size_t end) {
+    if(begin >= end) return true;
+#ifdef MAP_HUGETLB
+    if(p_alloc[0].huge_pages == HUGE_PAGES_HUGETLB) {
+        void* mapped = mmap(&(p_alloc[0].data[begin]), end - begin, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+        if(mapped != MAP_FAILED) return true;
+        /* a failed MAP_FIXED may have unmapped the range already, so it is reserved again first */
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#ifdef MAP_NORESERVE
+        flags |= MAP_NORESERVE;
+#endif
+        if(mmap(&(p_alloc[0].data[begin]), end - begin, PROT_NONE, flags, -1, 0) == MAP_FAILED) return false;
+        p_alloc[0].huge_pages = advise_huge_pages(p_alloc) ? HUGE_PAGES_TRANSPARENT : HUGE_PAGES_NONE;
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Huge page pool exhausted, falling back to transparent huge pages");
+    }
+#endif
+    return mprotect(&(p_alloc[0].data[begin]), end - begin, PROT_READ | PROT_WRITE) == 0;
+}
+
+/* reserves the address range for the data, aligned to a huge page if huge pages are in use */
+static void* reserve_data(const allocator* p_alloc) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    size_t bytes = os_page_bytes(p_alloc, p_alloc[0].reserved_pages);
+    size_t alignment = p_alloc[0].huge_page_bytes;
+    if(alignment == 0) {
+        void* reservation = mmap(NULL, bytes, PROT_NONE, flags, -1, 0);
+        return (reservation == MAP_FAILED) ? NULL : reservation;
+    }
+    /* over-reserves by one huge page and gives back what lies before and after the aligned range */
+    uint8_t *reservation = mmap(NULL, bytes + alignment, PROT_NONE, flags, -1, 0);
+    if(reservation == MAP_FAILED) return NULL;
+    uint8_t *aligned = (uint8_t*) ((((size_t) reservation) + alignment - 1) & ~(alignment - 1));
+    if(aligned > reservation) munmap(reservation, aligned - reservation);
+    if(aligned < reservation + alignment) munmap(aligned + bytes, reservation + alignment - aligned);
+    return aligned;
+}
+#endif
+
+/* marks the pages [first, last) as freed; under ZEROING_DISCARD their memory goes back to the kernel right away */
+static void release_pages(const allocator* p_alloc, uint32_t first, uint32_t last) {
+    COUNT_USED_PAGES(p_alloc, -(int64_t) allocations_in(p_alloc, first, last), -(int64_t) (last - first));
+    classes_release(p_alloc, first, last);
+    pat_set_range(p_alloc[0].PAT, first, last, 0x01);
+    uint32_t zero_first = first, zero_last = first;
+#ifdef ALLOC_HAVE_MMAP
+    if(p_alloc[0].zeroing == ZEROING_DISCARD && discard_pages(p_alloc, first, last, &zero_first, &zero_last)) {
+        pat_set_range(p_alloc[0].PAT, zero_first, zero_last, 0x00);
+        p_alloc[0].stats->pages_discarded += zero_last - zero_first;
+    }
+#endif
+    count_dirty_pages(p_alloc, (last - first) - (zero_last - zero_first));
+    update_free_run_index(p_alloc, first, last);
+}
+
+#ifdef ALLOC_HAVE_MMAP
+/* one purge step: gives back the 01 runs of at least ALLOC_PURGE_MIN_RUN_BYTES from the cursor on, until max_pages
+   are purged, the 01 pages are down to goal or the sweep has gone once around the PAT (then out_round_done is set).
+   The pages stay free, so the free-run index doesn't change */
+static uint32_t purge_step(const allocator* p_alloc, uint32_t max_pages, uint64_t goal, bool *out_round_done) {
+    struct allocator_purge *purge = p_alloc[0].purge;
+    uint32_t total = p_alloc[0].allocated_pages;
+    size_t min_run = (ALLOC_PURGE_MIN_RUN_BYTES + p_alloc[0].page_size - 1) / p_alloc[0].page_size;
+    uint32_t purged = 0;
+    while(purged < max_pages && purge->dirty_pages > goal && purge->swept_pages < total) {
+        if(purge->cursor >= total) purge->cursor = 0;
+        size_t limit = purge->cursor + (total - purge->swept_pages);
+        if(limit > total) limit = total;
+        size_t i = pat_find_page(p_alloc[0].PAT, purge->cursor, limit, PAT_DIRTY);
+        size_t end = limit;
+        if(i < limit) {
+            size_t run = pat_extend_run(p_alloc[0].PAT, i, total, PAT_DIRTY);
+            end = i + ((run < max_pages - purged) ? run : max_pages - purged);
+            uint32_t zero_first, zero_last;
+            if(run >= min_run && discard_pages(p_alloc, i, end, &zero_first, &zero_last)) {
+                pat_set_range(p_alloc[0].PAT, zero_first, zero_last, 0x00);
+                uncount_dirty_pages(p_alloc, zero_last - zero_first);
+                p_alloc[0].stats->pages_purged += zero_last - zero_first;
+                purged += zero_last - zero_first;
+            }
+            if(end > limit) end = limit;
+        }
+        purge->swept_pages += end - purge->cursor;
+        purge->cursor = end;
+    }
+    out_round_done[0] = (purge->swept_pages >= total || purge->dirty_pages <= goal);
+    return purged;
+}
+
+/* called by the allocation functions with the shared lock held: starts a purge when the 01 pages exceed the
+   watermark or the oldest of them passed the decay time, and advances an ongoing one by a step */
+static void purge_in_background(const allocator* p_alloc) {
+    struct allocator_purge *purge = p_alloc[0].purge;
+    if(purge->goal == PURGE_IDLE) {
+        uint64_t threshold = (purge->rearm_pages > purge->watermark_pages) ? purge->rearm_pages : purge->watermark_pages;
+        if(purge->watermark_pages != 0 && purge->dirty_pages > threshold) {
+            purge->goal = purge->watermark_pages / 2;
+        } else if(purge->deadline_ns != 0 && ++purge->calls % PURGE_CLOCK_CALLS == 0 && monotonic_ns() >= purge->deadline_ns) {
+            purge->goal = 0;
+        } else {
+            return;
+        }
+        purge->swept_pages = 0;
+    }
+    size_t step_bytes = (PURGE_STEP_BYTES > p_alloc[0].commit_bytes) ? PURGE_STEP_BYTES : p_alloc[0].commit_bytes;
+    bool round_done;
+    purge_step(p_alloc, step_bytes / p_alloc[0].page_size, purge->goal, &round_done);
+    if(!round_done) return;
+    /* what is left are runs too short to purge, which are neither purged again right away nor forgotten */
+    purge->rearm_pages = (purge->dirty_pages > purge->goal) ? purge->dirty_pages + purge->watermark_pages / 2 : 0;
+    if(purge->dirty_pages != 0 && (purge->goal == 0 || purge->deadline_ns == 0) && purge->decay_ns != 0) {
+        purge->deadline_ns = monotonic_ns() + purge->decay_ns;
+    }
+    purge->goal = PURGE_IDLE;
+}
+#else
+static void purge_in_background(const allocator* p_alloc) { (void) p_alloc; }
+#endif
+
+/* rounds up to whole pages */
+static size_t pages_for_size(const allocator* p_alloc, size_t size) {
+    return size / p_alloc[0].page_size + ((size % p_alloc[0].page_size) != 0);
+}
+
+static size_t shared_region_bytes(const allocator* p_alloc);
+
+static void release_data(const allocator* p_alloc) {
+    if(p_alloc[0].backend == BACKEND_CALLOC) {
+        free(p_alloc[0].data);
+    } else if(p_alloc[0].backend == BACKEND_SHARED) {
+#ifdef ALLOC_HAVE_PTHREADS
+        if(p_alloc[0].shared != NULL) munmap(p_alloc[0].shared, shared_region_bytes(p_alloc));
+#endif
+    } else {
+#ifdef ALLOC_HAVE_MMAP
+        if(p_alloc[0].data == NULL) return;
+        if(p_alloc[0].external_reservation) {
+            /* mapping fresh PROT_NONE pages over the range drops its contents but keeps it reserved for its owner */
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#ifdef MAP_NORESERVE
+            flags |= MAP_NORESERVE;
+#endif
+            mmap(p_alloc[0].data, os_page_bytes(p_alloc, p_alloc[0].reserved_pages), PROT_NONE, flags, -1, 0);
+        } else {
+            munmap(p_alloc[0].data, os_page_bytes(p_alloc, p_alloc[0].reserved_pages));
+        }
+#endif
+    }
+}
+
+
+/* concurrent mode: the shared PAT, free-run index and stats are guarded by one lock, which is held only for the
+   search and the marking. In front of it, every thread has a cache shard of recently freed small runs that stay
+   marked as allocated in the PAT, so an allocation of the page count of a recent free never takes the lock. Frees
+   still validate under the lock, and a bit per page flags the runs parked in the caches so that freeing, resizing
+   or measuring one of them again is rejected.
+   Threads are spread over the shards round robin; a shard is guarded by a spinlock that is only contended when
+   there are more threads than shards or when the caches are flushed. Shared allocators don't use the caches: a
+   process dying with a shard spinlock held or with runs parked in its shard couldn't be recovered from. */
+
+#define CACHE_SHARDS 64
+#define CACHE_RUNS_PER_SHARD 16
+#define CACHE_MAX_RUN_PAGES 16
+
+#ifdef ALLOC_HAVE_PTHREADS
+typedef struct cache_shard {
+    _Alignas(64) atomic_flag busy;
+    uint32_t count;
+    uint32_t first_page[CACHE_RUNS_PER_SHARD];
+    uint32_t pages[CACHE_RUNS_PER_SHARD];
+    allocator_stats stats;  /* counted here for allocations served from the shard, summed up by get_allocator_stats */
+} cache_shard;
+
+struct allocator_sync {
+    pthread_mutex_t lock;
+    cache_shard shards[CACHE_SHARDS];
+    _Atomic uint64_t *cached;  /* a bit per page, set on the first page of every cached run; NULL for shared allocators */
+};
+
+static atomic_uint next_thread_slot;
+static _Thread_local uint32_t thread_slot = UINT32_MAX;
+
+/* for shared allocators, the lock works across processes and is robust, so it is recovered when its owner dies */
+static bool init_sync(struct allocator_sync *sync, bool process_shared) {
+    memset(sync, 0, sizeof(struct allocator_sync));
+    pthread_mutexattr_t attributes;
+    if(pthread_mutexattr_init(&attributes) != 0) return false;
+    if(process_shared) {
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    }
+    int init_result = pthread_mutex_init(&(sync->lock), &attributes);
+    pthread_mutexattr_destroy(&attributes);
+    if(init_result != 0) return false;
+    for(uint32_t k = 0; k < CACHE_SHARDS; k++) atomic_flag_clear(&(sync->shards[k].busy));
+    return true;
+}
+
+static size_t cached_words(uint32_t page_number) {
+    return (PAT_bytes(page_number)*4 + 63) / 64;
+}
+
+static struct allocator_sync* create_sync(uint32_t page_number) {
+    size_t size = ((sizeof(struct allocator_sync) + 63) / 64) * 64;
+    struct allocator_sync *sync = aligned_alloc(64, size);
+    if(sync == NULL) return NULL;
+    if(!init_sync(sync, false)) {
+        free(sync);
+        return NULL;
+    }
+    sync->cached = calloc(cached_words(page_number), sizeof(uint64_t));
+    if(sync->cached == NULL) {
+        pthread_mutex_destroy(&(sync->lock));
+        free(sync);
+        return NULL;
+    }
+    return sync;
+}
+
+static void destroy_sync(struct allocator_sync *sync) {
+    if(sync == NULL) return;
+    pthread_mutex_destroy(&(sync->lock));
+    free(sync->cached);
+    free(sync);
+}
+
+/* called by expand_alloctor, which doesn't overlap with other calls, so no cache flag can change meanwhile */
+static bool grow_sync(struct allocator_sync *sync, uint32_t old_page_number, uint32_t new_page_number) {
+    if(sync == NULL || sync->cached == NULL) return true;
+    size_t old_words = cached_words(old_page_number);
+    size_t new_words = cached_words(new_page_number);
+    _Atomic uint64_t *cached = realloc(sync->cached, new_words*sizeof(uint64_t));
+    if(cached == NULL) return false;
+    for(size_t w = old_words; w < new_words; w++) atomic_init(&(cached[w]), 0);
+    sync->cached = cached;
+    return true;
+}
+
+static void recover_shared_state(const allocator* p_alloc);
+
+static void lock_shared(const allocator* p_alloc) {
+    if(p_alloc[0].sync != NULL && pthread_mutex_lock(&(p_alloc[0].sync->lock)) == EOWNERDEAD) {
+        /* a process died holding the lock of a shared allocator, maybe halfway through an update of the index */
+        pthread_mutex_consistent(&(p_alloc[0].sync->lock));
+        recover_shared_state(p_alloc);
+    }
+}
+
+static void unlock_shared(const allocator* p_alloc) {
+    if(p_alloc[0].sync != NULL) pthread_mutex_unlock(&(p_alloc[0].sync->lock));
+}
+
+static void lock_shard(cache_shard *shard) {
+    while(atomic_flag_test_and_set_explicit(&(shard->busy), memory_order_acquire)) ;
+}
+
+static void unlock_shard(cache_shard *shard) {
+    atomic_flag_clear_explicit(&(shard->busy), memory_order_release);
+}
+
+static bool uses_thread_caches(const allocator* p_alloc) {
+    return p_alloc[0].sync != NULL && p_alloc[0].backend != BACKEND_SHARED;
+}
+
+static void set_cached(const allocator* p_alloc, uint32_t first_page) {
+    atomic_fetch_or_explicit(&(p_alloc[0].sync->cached[first_page/64]), (uint64_t) 1 << (first_page%64), memory_order_release);
+}
+
+static void clear_cached(const allocator* p_alloc, uint32_t first_page) {
+    atomic_fetch_and_explicit(&(p_alloc[0].sync->cached[first_page/64]), ~((uint64_t) 1 << (first_page%64)), memory_order_release);
+}
+
+static bool is_cached(const allocator* p_alloc, uint32_t first_page) {
+    if(!uses_thread_caches(p_alloc)) return false;
+    return (atomic_load_explicit(&(p_alloc[0].sync->cached[first_page/64]), memory_order_acquire) >> (first_page%64)) & 1;
+}
+
+static cache_shard* own_shard(const allocator* p_alloc) {
+    if(thread_slot == UINT32_MAX) thread_slot = atomic_fetch_add(&next_thread_slot, 1);
+    return &(p_alloc[0].sync->shards[thread_slot % CACHE_SHARDS]);
+}
+
+static void add_stats(allocator_stats *total, const allocator_stats *part) {
+    total->zeroed_allocations_clean += part->zeroed_allocations_clean;
+    total->zeroed_allocations_memset += part->zeroed_allocations_memset;
+    total->pages_memset += part->pages_memset;
+    total->pages_discarded += part->pages_discarded;
+    total->pages_prezeroed += part->pages_prezeroed;
+    total->pages_purged += part->pages_purged;
+    total->allocations_made += part->allocations_made;
+    total->bytes_requested += part->bytes_requested;
+    total->bytes_rounded += part->bytes_rounded;
+    total->resize_bytes_copied += part->resize_bytes_copied;
+    total->resize_bytes_remapped += part->resize_bytes_remapped;
+}
+
+static void add_cache_stats(const allocator* p_alloc, allocator_stats *total) {
+    if(!uses_thread_caches(p_alloc)) return;
+    for(uint32_t k = 0; k < CACHE_SHARDS; k++) {
+        cache_shard *shard = &(p_alloc[0].sync->shards[k]);
+        lock_shard(shard);
+        add_stats(total, &(shard->stats));
+        unlock_shard(shard);
+    }
+}
+
+/* hands every cached run back to the shared pages; the shared lock must be held */
+static void flush_caches_locked(const allocator* p_alloc) {
+    if(!uses_thread_caches(p_alloc)) return;
+    for(uint32_t k = 0; k < CACHE_SHARDS; k++) {
+        cache_shard *shard = &(p_alloc[0].sync->shards[k]);
+        lock_shard(shard);
+        for(uint32_t j = 0; j < shard->count; j++) {
+            clear_cached(p_alloc, shard->first_page[j]);
+            release_pages(p_alloc, shard->first_page[j], shard->first_page[j] + shard->pages[j]);
+        }
+        shard->count = 0;
+        unlock_shard(shard);
+    }
+}
+#else
+struct allocator_sync { int unused; };
+static struct allocator_sync* create_sync(uint32_t page_number) { (void) page_number; return NULL; }
+static void destroy_sync(struct allocator_sync *sync) { (void) sync; }
+static bool grow_sync(struct allocator_sync *sync, uint32_t old_page_number, uint32_t new_page_number) { (void) sync; (void) old_page_number; (void) new_page_number; return true; }
+static void lock_shared(const allocator* p_alloc) { (void) p_alloc; }
+static void unlock_shared(const allocator* p_alloc) { (void) p_alloc; }
+static bool is_cached(const allocator* p_alloc, uint32_t first_page) { (void) p_alloc; (void) first_page; return false; }
+static bool uses_thread_caches(const allocator* p_alloc) { (void) p_alloc; return false; }
+static void add_cache_stats(const allocator* p_alloc, allocator_stats *total) { (void) p_alloc; (void) total; }
+#endif
 
 
 alloc_result init_allocator(uint32_t page_size_bytes, uint32_t initial_page_number, PFN_alloc_log log_function, allocator* out_alloc) {
+    return init_allocator_options(page_size_bytes, initial_page_number, NULL, log_function, out_alloc);
+}
+
+alloc_result init_allocator_options(uint32_t page_size_bytes, uint32_t initial_page_number, const allocator_options* options, PFN_alloc_log log_function, allocator* out_alloc) {
+    allocator_options default_options = { BACKEND_CALLOC, 0, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    if(options == NULL) options = &default_options;
     if(out_alloc == NULL) {
         if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Out-parameter for Allocator struct is NULL!");
         return INVALID_PARAMETER;
     }
-    if(page_size_bytes % 64 != 0) {
+    if(page_size_bytes == 0 || page_size_bytes % 64 != 0) {
         if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Page size not a multiple of 64 bytes!");
         return INVALID_PARAMETER;
     }
@@ -18,25 +959,142 @@ alloc_result init_allocator(uint32_t page_size_bytes, uint32_t initial_page_numb
         if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Page number not a multiple of 4!");
         return INVALID_PARAMETER;
     }
-     
+#ifndef ALLOC_HAVE_MMAP
+    if(options[0].backend == BACKEND_MMAP) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "The mmap backend is not available on this platform!");
+        return INVALID_PARAMETER;
+    }
+#endif
+    if(options[0].backend == BACKEND_SHARED) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Shared allocators are made with init_allocator_shared!");
+        return INVALID_PARAMETER;
+    }
+#ifndef ALLOC_HAVE_PTHREADS
+    if(options[0].concurrent) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Concurrent allocators are not available on this platform!");
+        return INVALID_PARAMETER;
+    }
+#endif
+    if(options[0].placement > PLACEMENT_SEGREGATED_FIT) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Unknown placement policy!");
+        return INVALID_PARAMETER;
+    }
+    if(options[0].zeroing == ZEROING_DISCARD && options[0].backend != BACKEND_MMAP) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Discarding freed pages needs the mmap backend!");
+        return INVALID_PARAMETER;
+    }
+    if(options[0].huge_pages > HUGE_PAGES_HUGETLB || (options[0].huge_pages != HUGE_PAGES_NONE && options[0].backend != BACKEND_MMAP)) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Huge pages need the mmap backend!");
+        return INVALID_PARAMETER;
+    }
+    if((options[0].purge_watermark_pages != 0 || options[0].purge_decay_ms != 0) && options[0].backend != BACKEND_MMAP) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Purging freed pages needs the mmap backend!");
+        return INVALID_PARAMETER;
+    }
+    
+    uint32_t reserved_pages = initial_page_number;
+    if(options[0].backend == BACKEND_MMAP) {
+        size_t default_reserve = ALLOC_DEFAULT_RESERVE_BYTES / page_size_bytes;
+        if(default_reserve > UINT32_MAX) default_reserve = UINT32_MAX;
+        if(options[0].reserved_address != NULL && options[0].reserved_pages == 0) {
+            if(log_function != NULL) log_function(INITIALIZATION_ERROR, "A given reserved address range needs its page number!");
+            return INVALID_PARAMETER;
+        }
+        reserved_pages = (options[0].reserved_pages != 0) ? options[0].reserved_pages : (uint32_t) default_reserve;
+        reserved_pages -= reserved_pages % 4;
+        if(reserved_pages < initial_page_number) {
+            if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Reserved page number smaller than the initial page number!");
+            return INVALID_PARAMETER;
+        }
+    }
+    
     out_alloc[0].page_size = page_size_bytes;
     out_alloc[0].allocated_pages = initial_page_number;
     out_alloc[0].log_function = log_function;
+    out_alloc[0].free_runs = NULL;
+    out_alloc[0].backend = options[0].backend;
+    out_alloc[0].reserved_pages = reserved_pages;
+    out_alloc[0].external_reservation = (options[0].backend == BACKEND_MMAP && options[0].reserved_address != NULL);
+    out_alloc[0].zeroing = options[0].zeroing;
+    out_alloc[0].placement = options[0].placement;
+    out_alloc[0].huge_pages = HUGE_PAGES_NONE;
+    out_alloc[0].huge_page_bytes = 0;
+    out_alloc[0].commit_bytes = 0;
+    out_alloc[0].stats = NULL;
+    out_alloc[0].purge = NULL;
+    out_alloc[0].sync = NULL;
+    out_alloc[0].shared = NULL;
     
-    size_t allocation_size = initial_page_number * page_size_bytes;
-    size_t PAT_size = allocation_size / 4;
+    size_t allocation_size = (size_t) initial_page_number * page_size_bytes;
+    size_t PAT_size = PAT_bytes(initial_page_number);
     
     out_alloc[0].PAT = calloc(PAT_size,sizeof(uint8_t));
-    if(out_alloc[0].PAT == NULL) {
+    out_alloc[0].run_pages = calloc(PAT_size*4,sizeof(uint32_t));
+    if(out_alloc[0].PAT == NULL || out_alloc[0].run_pages == NULL) {
+        free(out_alloc[0].PAT);
+        free(out_alloc[0].run_pages);
         if(out_alloc[0].log_function != NULL) out_alloc[0].log_function(INITIALIZATION_ERROR, "Ran out of system memory when trying to allocate Page Allocation Table");
         return OUT_OF_MEMORY;
     }
-    out_alloc[0].data = calloc(allocation_size,sizeof(uint8_t));
+    pat_set_range(out_alloc[0].PAT, initial_page_number, PAT_size*4, 0x03);
+    if(out_alloc[0].backend == BACKEND_CALLOC) {
+        out_alloc[0].data = calloc(allocation_size,sizeof(uint8_t));
+    } else {
+#ifdef ALLOC_HAVE_MMAP
+        /* only the address range is reserved here, the pages are committed as the allocator grows */
+        out_alloc[0].commit_bytes = os_page_size();
+        if(options[0].huge_pages != HUGE_PAGES_NONE) {
+            out_alloc[0].huge_page_bytes = huge_page_size(options[0].huge_pages);
+            out_alloc[0].huge_pages = (out_alloc[0].huge_page_bytes != 0) ? options[0].huge_pages : HUGE_PAGES_NONE;
+        }
+        /* the huge page pool can only back a range that is aligned to its pages and a multiple of them */
+        size_t huge_bytes = out_alloc[0].huge_page_bytes;
+        if(out_alloc[0].huge_pages == HUGE_PAGES_HUGETLB && options[0].reserved_address != NULL
+            && (((size_t) options[0].reserved_address) % huge_bytes != 0 || ((size_t) reserved_pages * page_size_bytes) % huge_bytes != 0)) {
+            out_alloc[0].huge_pages = HUGE_PAGES_TRANSPARENT;
+        }
+        if(out_alloc[0].huge_pages == HUGE_PAGES_HUGETLB) out_alloc[0].commit_bytes = huge_bytes;
+        out_alloc[0].data = (options[0].reserved_address != NULL) ? options[0].reserved_address : reserve_data(out_alloc);
+        if(out_alloc[0].data != NULL && out_alloc[0].huge_pages == HUGE_PAGES_TRANSPARENT && !advise_huge_pages(out_alloc)) {
+            out_alloc[0].huge_pages = HUGE_PAGES_NONE;
+        }
+        if(out_alloc[0].data != NULL && !commit_data(out_alloc, 0, os_page_bytes(out_alloc, initial_page_number))) {
+            release_data(out_alloc);
+            out_alloc[0].data = NULL;
+        }
+        if(out_alloc[0].huge_pages == HUGE_PAGES_NONE) out_alloc[0].huge_page_bytes = 0;
+#endif
+    }
     if(out_alloc[0].data == NULL) {
+        free(out_alloc[0].PAT);
+        free(out_alloc[0].run_pages);
         if(out_alloc[0].log_function != NULL) out_alloc[0].log_function(INITIALIZATION_ERROR, "Ran out of system memory when trying to allocate memory pages");
         return OUT_OF_MEMORY;
     }
+    out_alloc[0].free_runs = calloc(1,sizeof(struct free_run_index));
+    out_alloc[0].stats = calloc(1,sizeof(allocator_stats));
+    out_alloc[0].purge = calloc(1,sizeof(struct allocator_purge));
+    if(options[0].concurrent) out_alloc[0].sync = create_sync(initial_page_number);
+    if(out_alloc[0].free_runs == NULL || out_alloc[0].stats == NULL || out_alloc[0].purge == NULL || (options[0].concurrent && out_alloc[0].sync == NULL) || build_free_run_index(out_alloc) != SUCCESS) {
+        destroy_sync(out_alloc[0].sync);
+        free(out_alloc[0].purge);
+        free(out_alloc[0].stats);
+        free_run_index_destroy(out_alloc[0].free_runs);
+        free(out_alloc[0].PAT);
+        free(out_alloc[0].run_pages);
+        release_data(out_alloc);
+        if(out_alloc[0].log_function != NULL) out_alloc[0].log_function(INITIALIZATION_ERROR, "Ran out of system memory when trying to allocate the free-run index");
+        return OUT_OF_MEMORY;
+    }
+    out_alloc[0].purge->watermark_pages = options[0].purge_watermark_pages;
+    out_alloc[0].purge->decay_ns = (uint64_t) options[0].purge_decay_ms * 1000000;
+    out_alloc[0].purge->goal = PURGE_IDLE;
+    start_trace(out_alloc);
     
+    if(options[0].huge_pages != HUGE_PAGES_NONE && out_alloc[0].log_function != NULL) {
+        const char* backing[] = { "Huge pages unavailable, the data is backed by regular pages", "The data is backed by transparent huge pages", "The data is backed by the huge page pool" };
+        out_alloc[0].log_function(NOTE, (char*) backing[out_alloc[0].huge_pages]);
+    }
     if(out_alloc[0].log_function != NULL) out_alloc[0].log_function(INITIALIZATION_SUCCESS, "Successfully initialized the allocator memory pages");
     
     return SUCCESS;
@@ -54,9 +1112,17 @@ alloc_result expand_alloctor(allocator* p_alloc, uint32_t new_page_number) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_SUCCESS, "Allocator memory expansion successful due to not exceeding old allocation size");
         return SUCCESS;
     }
+    if(p_alloc[0].backend == BACKEND_SHARED) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Shared allocators can't be expanded!");
+        return INVALID_PARAMETER;
+    }
+    if(p_alloc[0].backend == BACKEND_MMAP && new_page_number > p_alloc[0].reserved_pages) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "New page number exceeds the reserved address range!");
+        return OUT_OF_MEMORY;
+    }
     
-    size_t new_alloc_size = new_page_number * p_alloc[0].page_size;
-    size_t new_PAT_size = new_alloc_size / 4;
+    size_t new_alloc_size = (size_t) new_page_number * p_alloc[0].page_size;
+    size_t new_PAT_size = PAT_bytes(new_page_number);
     
     void* new_PAT_ptr = realloc(p_alloc[0].PAT, new_PAT_size);
     if(new_PAT_ptr == NULL) {
@@ -64,15 +1130,55 @@ alloc_result expand_alloctor(allocator* p_alloc, uint32_t new_page_number) {
         return OUT_OF_MEMORY;
     }
     p_alloc[0].PAT = new_PAT_ptr;
-    void* new_data_ptr = realloc(p_alloc[0].data, new_alloc_size);
-    if(new_data_ptr == NULL) {
-        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Ran out of system memory when trying to expand memory pages");
+    uint32_t *new_run_pages = realloc(p_alloc[0].run_pages, new_PAT_size*4*sizeof(uint32_t));
+    if(new_run_pages == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Ran out of system memory when trying to expand the run length table");
+        return OUT_OF_MEMORY;
+    }
+    p_alloc[0].run_pages = new_run_pages;
+    if(!grow_sync(p_alloc[0].sync, p_alloc[0].allocated_pages, new_page_number)) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Ran out of system memory when trying to expand the thread cache flags");
         return OUT_OF_MEMORY;
     }
-    p_alloc[0].data = new_data_ptr;
+    if(p_alloc[0].backend == BACKEND_CALLOC) {
+        void* new_data_ptr = realloc(p_alloc[0].data, new_alloc_size);
+        if(new_data_ptr == NULL) {
+            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Ran out of system memory when trying to expand memory pages");
+            return OUT_OF_MEMORY;
+        }
+        p_alloc[0].data = new_data_ptr;
+        /* realloc doesn't zero the new memory, so the new pages start out as 01 */
+        pat_set_range(p_alloc[0].PAT, p_alloc[0].allocated_pages, new_page_number, 0x01);
+        count_dirty_pages(p_alloc, new_page_number - p_alloc[0].allocated_pages);
+    } else {
+#ifdef ALLOC_HAVE_MMAP
+        /* committing only touches the new pages: nothing is copied and the data never moves */
+        size_t committed = os_page_bytes(p_alloc, p_alloc[0].allocated_pages);
+        size_t needed = os_page_bytes(p_alloc, new_page_number);
+        if(!commit_data(p_alloc, committed, needed)) {
+            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Ran out of system memory when trying to commit memory pages");
+            return OUT_OF_MEMORY;
+        }
+#endif
+        /* freshly committed anonymous memory is zeroed by the kernel */
+        pat_set_range(p_alloc[0].PAT, p_alloc[0].allocated_pages, new_page_number, 0x00);
+    }
+    pat_set_range(p_alloc[0].PAT, new_page_number, new_PAT_size*4, 0x03);
     
+    uint32_t old_page_number = p_alloc[0].allocated_pages;
     p_alloc[0].allocated_pages = new_page_number;
     
+    if(build_free_run_index(p_alloc) != SUCCESS) {
+        /* back to the old size: the new pages are padding again, marked 11 so the kernels still stop at the end,
+           and the index is rebuilt for the old pages as far as the memory allows */
+        pat_set_range(p_alloc[0].PAT, old_page_number, new_PAT_size*4, 0x03);
+        if(p_alloc[0].backend == BACKEND_CALLOC) uncount_dirty_pages(p_alloc, new_page_number - old_page_number);
+        p_alloc[0].allocated_pages = old_page_number;
+        build_free_run_index(p_alloc);
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_ERROR, "Ran out of system memory when trying to expand the free-run index");
+        return OUT_OF_MEMORY;
+    }
+    
     if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(EXPANSION_SUCCESS, "Successfully expanded the allocator memory pages");
     
     return SUCCESS;
@@ -85,8 +1191,23 @@ alloc_result deinit_allocator(allocator* p_alloc) {
     
     PFN_alloc_log log_function = p_alloc[0].log_function;
     
-    free(p_alloc[0].PAT);
-    free(p_alloc[0].data);
+    if(p_alloc[0].backend == BACKEND_SHARED) {
+        /* all but this process's handle on the index lives in the mapping, which stays for the other processes */
+        if(p_alloc[0].free_runs != NULL) p_alloc[0].free_runs->nodes = NULL;
+        free_run_index_destroy(p_alloc[0].free_runs);
+        release_data(p_alloc);
+    } else {
+        free(p_alloc[0].PAT);
+        free(p_alloc[0].run_pages);
+        release_data(p_alloc);
+        free_run_index_destroy(p_alloc[0].free_runs);
+        free(p_alloc[0].stats);
+        free(p_alloc[0].purge);
+        destroy_sync(p_alloc[0].sync);
+    }
+#ifdef ALLOC_TRACE
+    free(p_alloc[0].trace);
+#endif
     
     void* memset_return = memset(p_alloc, 0, sizeof(allocator));
     if(memset_return != p_alloc) {
@@ -100,16 +1221,94 @@ alloc_result deinit_allocator(allocator* p_alloc) {
 }
 
 
-static bool alignment_satisfied(int i, uint32_t page_size, int alignment_bits, size_t offset_to_alignment, uint8_t *data) {
-    if(alignment_bits <= 6 && offset % 64 == 0) return true; /* this is the multiplier in init_allocator and expand_alloctor, currently 64 = 2**6 */
-    uint8_t *actual_address = &(data[i*page_size + offset]);
-    size_t alignment_mask = (1 << alignment_bits) - 1;
+static bool alignment_satisfied(uint32_t i, uint32_t page_size, int alignment_bits, size_t offset_to_alignment, uint8_t *data) {
+    /* pages are multiples of 64 = 2**6 bytes (see init_allocator), but calloc'd data itself may be less aligned */
+    if(alignment_bits <= 6 && offset_to_alignment % 64 == 0 && ((size_t) data % 64) == 0) return true;
+    uint8_t *actual_address = &(data[(size_t) i*page_size + offset_to_alignment]);
+    size_t alignment_mask = ((size_t) 1 << alignment_bits) - 1;
     return ((((size_t)actual_address) & alignment_mask) == 0);
 }
 
-alloc_result alloc_align_offset_zeroable(const allocator* p_alloc, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
-    if(p_alloc == NULL) {
-        return INVALID_PARAMETER;
+/* the pages whose address (plus offset_to_alignment) is aligned to 2**alignment_bits are first, first + stride,
+   first + 2*stride, ...: page i is aligned iff i*page_size = -(data + offset) modulo 2**alignment_bits, which with
+   g = gcd(page_size, 2**alignment_bits) has a solution iff g divides the right side, and then one every
+   2**alignment_bits/g pages. Returns false if no page can ever be aligned */
+static bool aligned_pages(const allocator* p_alloc, int alignment_bits, size_t offset_to_alignment, uint64_t *out_first, uint64_t *out_stride) {
+    uint64_t modulus_mask = (alignment_bits >= 64) ? ~0ULL : (((uint64_t) 1 << alignment_bits) - 1);
+    uint64_t target = (0 - ((uint64_t) (size_t) p_alloc[0].data + offset_to_alignment)) & modulus_mask;
+    uint64_t page_size = p_alloc[0].page_size;
+    uint64_t g = page_size & (0 - page_size);
+    if(g > modulus_mask) g = modulus_mask + 1;
+    if(target % g != 0) return false;
+    uint64_t stride = (modulus_mask / g) + 1;
+    /* page_size/g is odd unless the stride is 1, so it has an inverse modulo the stride (by Newton's iteration) */
+    uint64_t odd = page_size / g;
+    uint64_t inverse = odd;
+    for(int k = 0; k < 5; k++) inverse *= 2 - odd*inverse;
+    out_first[0] = ((target / g) * inverse) & (stride - 1);
+    out_stride[0] = stride;
+    return true;
+}
+
+/* the first of the aligned pages (see aligned_pages) at or after page i */
+static inline uint64_t next_aligned_page(uint64_t i, uint64_t first, uint64_t stride) {
+    if(i <= first) return first;
+    return first + ((i - first + stride - 1) / stride) * stride;
+}
+
+/* zeroes the 01 pages among [first, last) if asked to and marks the range as allocated: as consecutive new
+   allocations of allocation_pages pages each, or as a continuation if allocation_pages is 0 (the caller then
+   updates the run length of the allocation it belongs to) */
+static alloc_result claim_pages(const allocator* p_alloc, uint32_t first, uint32_t last, bool zeroed, uint32_t allocation_pages, alloc_code error_code) {
+    if(pat_extend_run(p_alloc[0].PAT, first, last, PAT_FREE) != last - first) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(error_code, "During zeroing of the memory allocation the PAT appears to have been externally manipulated!");
+        return ERROR_UNKNOWN;
+    }
+    size_t pages_per_allocation = (allocation_pages != 0) ? allocation_pages : last - first;
+    size_t allocations = (last - first) / pages_per_allocation;
+    size_t memset_allocations = 0;
+    size_t counted_allocations = 0;  /* allocations [0, counted_allocations) are already settled */
+    size_t i = pat_find_page(p_alloc[0].PAT, first, last, PAT_DIRTY);
+    while(i < last) {
+        size_t dirty_pages = pat_extend_run(p_alloc[0].PAT, i, last, PAT_DIRTY);
+        uncount_dirty_pages(p_alloc, dirty_pages);
+        if(zeroed) {
+            uint8_t *pages = &(p_alloc[0].data[i*p_alloc[0].page_size]);
+            void* memset_return = memset(pages, 0, dirty_pages*p_alloc[0].page_size);
+            if(memset_return != pages) {
+                if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(error_code, "Unknown error: memset returns wrong pointer!");
+                return ERROR_UNKNOWN;
+            }
+            p_alloc[0].stats->pages_memset += dirty_pages;
+            /* every allocation this dirty run reaches into counts once */
+            size_t reached_first = (i - first) / pages_per_allocation;
+            size_t reached_last = (i + dirty_pages - 1 - first) / pages_per_allocation + 1;
+            if(reached_first < counted_allocations) reached_first = counted_allocations;
+            if(reached_last > reached_first) memset_allocations += reached_last - reached_first;
+            if(reached_last > counted_allocations) counted_allocations = reached_last;
+        }
+        i = pat_find_page(p_alloc[0].PAT, i + dirty_pages, last, PAT_DIRTY);
+    }
+    if(zeroed) {
+        p_alloc[0].stats->zeroed_allocations_memset += memset_allocations;
+        p_alloc[0].stats->zeroed_allocations_clean += allocations - memset_allocations;
+    }
+    classes_claim(p_alloc, first, last);
+    pat_set_range(p_alloc[0].PAT, first, last, 0x03);
+    uint32_t starts = 0;
+    for(uint32_t start = first; allocation_pages != 0 && start < last; start += allocation_pages) {
+        pat_set_range(p_alloc[0].PAT, start, start + 1, 0x02);
+        p_alloc[0].run_pages[start] = allocation_pages;
+        starts++;
+    }
+    COUNT_USED_PAGES(p_alloc, starts, last - first);
+    update_free_run_index(p_alloc, first, last);
+    return SUCCESS;
+}
+
+static alloc_result alloc_align_offset_zeroable_unlocked(const allocator* p_alloc, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
     }
     if(out_ptr == NULL) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "Out-pointer to store memory pointer is NULL!");
@@ -120,8 +1319,7 @@ alloc_result alloc_align_offset_zeroable(const allocator* p_alloc, size_t size,
         return INVALID_PARAMETER;
     }
     
-    /* we need to divide as floating point so we can round up */
-    size_t used_pages = (size_t) ceil(((float)size)/((float)p_alloc[0].page_size));
+    size_t used_pages = pages_for_size(p_alloc, size);
     
     if(used_pages > p_alloc[0].allocated_pages) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "Asked-for memory exceeds allocator memory pages!");
@@ -129,30 +1327,25 @@ alloc_result alloc_align_offset_zeroable(const allocator* p_alloc, size_t size,
     }
     
     bool found = false;
-    int length_found = 0;
-    int initial_index = 0;
-    for(int i = 0; i < p_alloc[0].allocated_pages; i++) {
-        int state = (p_alloc[0].PAT[i/4] >> (i%4)*2) & 0x3;
-        switch(state) {
-            /* 00 */ case 0x00:
-            /* 01 */ case 0x01:
-                if(!found && (alignment_bits == 0 || alignment_satisfied(i, p_alloc[0].page_size, alignment_bits, offset_to_alignment, p_alloc[0].data))) {
-                    found = true;
-                    initial_index = i;
-                }
-                length_found++;
-            break;
-            /* 10 */ case 0x02:
-            /* 11 */ case 0x03:
-                if(length_found >= used_pages) goto after_loop;
-                else {
-                    found = false;
-                    length_found = 0;
-                }
-            break;
+    uint32_t initial_index = 0;
+    if(alignment_bits == 0) {
+        found = find_placement(p_alloc, used_pages, &initial_index);
+    } else {
+        /* only every stride-th page is aligned: the index gives the first fitting run at or after a candidate, and
+           if that run doesn't start right at it, the search jumps to the first candidate at or after that run */
+        uint64_t candidate, stride;
+        bool alignable = aligned_pages(p_alloc, alignment_bits, offset_to_alignment, &candidate, &stride);
+        while(alignable && !found && candidate + used_pages <= p_alloc[0].allocated_pages) {
+            uint32_t fit;
+            if(!find_free_run_after(p_alloc, used_pages, (uint32_t) candidate, &fit)) break;
+            if(fit == candidate) {
+                found = true;
+                initial_index = fit;
+            } else {
+                candidate = next_aligned_page(fit, candidate, stride);
+            }
         }
     }
-    after_loop:
     
     if(!found) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "The allocator has no area available for allocation due to use or fragmentation");
@@ -160,43 +1353,16 @@ alloc_result alloc_align_offset_zeroable(const allocator* p_alloc, size_t size,
     }
     
     /* for zeroeing memory and setting the markings, we need to go through the array again, since the first round we couldn't know if the page gap was large enough: */
-    for(int i = initial_index; i < used_pages; i++) {
-        int old_value = p_alloc[0].PAT[i/4];
-        int old_state = (old_value >> (i%4)*2) & 0x3;
-        if(zeroed) {
-            switch(old_state) {
-                /* 00 */ case 0x00:
-                break;
-                /* 01 */ case 0x01:
-                    void* memset_return = memset(p_alloc[0].data[i*page_size], 0, page_size);
-                    if(memset_return != p_alloc) {
-                        if(log_function != NULL) log_function(ALLOCATION_ERROR, "Unknown error: memset returns wrong pointer!");
-                        return ERROR_UNKNOWN;
-                    }
-                break;
-                /* 10 */ case 0x02:
-                /* 11 */ case 0x03:
-                    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "During zeroing of the memory allocation the PAT appears to have been externally manipulated!");
-                    return ERROR_UNKNOWN;
-                break;
-            }
-        }
-        int new_state = (i == initial_index) ? 0x02 : 0x03;
-        int new_value = new_state << (i%4)*2;
-        int write_mask = (0x3 << (i%4)*2);
-        int old_mask = 0xFF - write_mask;
-        p_alloc[0].PAT[i/4] = (old_value&old_mask) | new_value;
-    }
+    alloc_result claim_result = claim_pages(p_alloc, initial_index, initial_index + used_pages, zeroed, used_pages, ALLOCATION_ERROR);
+    if(claim_result != SUCCESS) return claim_result;
+    COUNT_REQUESTS(p_alloc[0].stats, 1, size, used_pages*p_alloc[0].page_size);
     
-    out_ptr[0] = &(p_alloc[0].data[initial_index*page_size]);
-    if(log_function != NULL) log_function(ALLOCATION_SUCCESS, "Successfully allocated memory");
+    out_ptr[0] = &(p_alloc[0].data[(size_t) initial_index*p_alloc[0].page_size]);
+    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_SUCCESS, "Successfully allocated memory");
     return SUCCESS;
 }
 
-alloc_result get_size(const allocator* p_alloc, void* ptr, size_t* size) {
-    if(p_alloc == NULL) {
-        return INVALID_PARAMETER;
-    }
+static alloc_result get_size_unlocked(const allocator* p_alloc, void* ptr, size_t* size) {
     if(ptr == NULL) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(SIZE_ERROR, "Poitnter ro calculate size is NULL!");
         return INVALID_PARAMETER;
@@ -206,32 +1372,121 @@ alloc_result get_size(const allocator* p_alloc, void* ptr, size_t* size) {
         return INVALID_PARAMETER;
     }
     
-    int first_index = (((size_t)ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
-    if(first_index < 0 || first_index >= p_alloc[0].allocated_pages) {
+    if(((uint8_t*)ptr) < p_alloc[0].data || (((size_t)ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size >= p_alloc[0].allocated_pages) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(SIZE_ERROR, "Pointer outside of memory pages!");
         return INVALID_ADDRESS;
     }
+    uint32_t first_index = (((size_t)ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
     
-    int nr_of_used_pages = 1;
-    for(int i = first_index; i < p_alloc[0].allocated_pages; i++) {
-        int value = p_alloc[0].PAT[i/4];
-        int state = (value >> (i%4)*2) & 0x3;
-        if(((i == first_index) && (state != 0x02))) {
-            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(SIZE_ERROR, "Pointer doesn't point to begin of allocation!");
-            return INVALID_ADDRESS;
-        }
-        if((i != first_index)) {
-            if(state == 0x03) nr_of_used_pages++;
-            else break;
-        }
+    if(page_state(p_alloc[0].PAT, first_index) != 0x02 || ((((size_t)ptr) - ((size_t)p_alloc[0].data)) % p_alloc[0].page_size) != 0) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(SIZE_ERROR, "Pointer doesn't point to begin of allocation!");
+        return INVALID_ADDRESS;
+    }
+    if(is_cached(p_alloc, first_index)) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(SIZE_ERROR, "Pointer was already freed!");
+        return INVALID_ADDRESS;
     }
     
-    size[0] = nr_of_used_pages*p_alloc[0].page_size;
+    size[0] = (size_t) p_alloc[0].run_pages[first_index]*p_alloc[0].page_size;
     if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(SIZE_SUCCESS, "Size successfully measured");
     return SUCCESS;
 }
 
-alloc_result resize_oldsize_zeroable(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool allow_new_alignment, bool zero_new_pages, void** new_ptr) {
+alloc_result get_size(const allocator* p_alloc, void* ptr, size_t* size) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    alloc_result result = get_size_unlocked(p_alloc, ptr, size);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+static alloc_result resize_oldsize_zeroable_copy_unlocked(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr);
+static alloc_result free_size_unlocked(const allocator* p_alloc, void* ptr, size_t old_size);
+
+/* grows the allocation at old_index over the after free pages that follow it and the free pages right before it, as
+   many as are still missing: the data moves down by that prefix with memmove, and the pages its old end leaves
+   behind are zeroed along with the ones after it if asked to */
+static alloc_result grow_into_prefix(const allocator* p_alloc, void* old_ptr, uint32_t old_index, size_t old_pages, size_t new_pages, size_t after, bool zero_new_pages, void** new_ptr) {
+    size_t prefix = new_pages - old_pages - after;
+    uint32_t new_index = old_index - (uint32_t) prefix;
+    uint64_t clean_before = p_alloc[0].stats->zeroed_allocations_clean;
+    if(after != 0) {
+        alloc_result claim_result = claim_pages(p_alloc, old_index + old_pages, old_index + old_pages + after, zero_new_pages, 0, REALLOCATION_ERROR);
+        if(claim_result != SUCCESS) return claim_result;
+    }
+    alloc_result claim_result = claim_pages(p_alloc, new_index, old_index, false, new_pages, REALLOCATION_ERROR);
+    if(claim_result != SUCCESS) return claim_result;
+    pat_set_range(p_alloc[0].PAT, old_index, old_index + 1, 0x03);
+    COUNT_USED_PAGES(p_alloc, -1, 0);
+
+    uint8_t *new_data = &(p_alloc[0].data[(size_t) new_index*p_alloc[0].page_size]);
+    memmove(new_data, old_ptr, old_pages*p_alloc[0].page_size);
+    if(zero_new_pages) {
+        memset(&(new_data[old_pages*p_alloc[0].page_size]), 0, prefix*p_alloc[0].page_size);
+        /* counted as claim_pages counts: the growth is one zeroed allocation, and one that took a memset, even if
+           the claim of the pages after it found them clean */
+        p_alloc[0].stats->pages_memset += prefix;
+        if(after == 0 || p_alloc[0].stats->zeroed_allocations_clean != clean_before) p_alloc[0].stats->zeroed_allocations_memset++;
+        p_alloc[0].stats->zeroed_allocations_clean = clean_before;
+    }
+    COUNT_RESIZE_BYTES(p_alloc[0].stats, old_pages*p_alloc[0].page_size, 0);
+    new_ptr[0] = new_data;
+    return SUCCESS;
+}
+
+#if defined(ALLOC_HAVE_MMAP) && defined(MREMAP_DONTUNMAP)
+/* BACKEND_MMAP only: grows an allocation of at least ALLOC_REMAP_MIN_BYTES by moving the whole OS pages of its data
+   to a new place with mremap, which only rewrites page tables, and copying just the partial pages at its ends. The
+   new place lies at the same offset into an OS page as the old one. MREMAP_DONTUNMAP leaves the old range mapped,
+   so the reservation has no hole, and empty, so its pages are freed as 00. Returns false with nothing changed if
+   the allocation is too small, no new place is free or the kernel refuses */
+static bool remap_grow(const allocator* p_alloc, void* old_ptr, uint32_t old_index, size_t old_pages, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr) {
+    size_t old_bytes = old_pages*p_alloc[0].page_size;
+    size_t unit = p_alloc[0].commit_bytes;
+    if(p_alloc[0].backend != BACKEND_MMAP || p_alloc[0].huge_pages == HUGE_PAGES_HUGETLB || old_bytes < ALLOC_REMAP_MIN_BYTES) return false;
+
+    int unit_bits = 0;
+    while(((size_t) 1 << unit_bits) < unit) unit_bits++;
+    if(alignment_bits < unit_bits) {
+        alignment_bits = unit_bits;
+        offset_to_alignment = (unit - (size_t) old_ptr % unit) % unit;
+    }
+    void* moved_ptr;
+    if(alloc_align_offset_zeroable_unlocked(p_alloc, new_size, alignment_bits, offset_to_alignment, false, &moved_ptr) != SUCCESS) return false;
+    uint32_t new_index = (uint32_t) (((uint8_t*) moved_ptr - p_alloc[0].data) / p_alloc[0].page_size);
+    size_t new_pages = pages_for_size(p_alloc, new_size);
+
+    uint8_t *source = old_ptr, *target = moved_ptr;
+    size_t head = (unit - (size_t) source % unit) % unit;
+    size_t body = ((old_bytes - head) / unit) * unit;
+    if(mremap(&(source[head]), body, body, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP, &(target[head])) == MAP_FAILED) {
+        release_pages(p_alloc, new_index, new_index + new_pages);
+        return false;
+    }
+    memcpy(target, source, head);
+    memcpy(&(target[head + body]), &(source[head + body]), old_bytes - head - body);
+    if(zero_new_pages) memset(&(target[old_bytes]), 0, new_pages*p_alloc[0].page_size - old_bytes);
+    COUNT_RESIZE_BYTES(p_alloc[0].stats, old_bytes - body, body);
+
+    /* the pages wholly inside the moved body read as zero now */
+    release_pages(p_alloc, old_index, old_index + old_pages);
+    size_t zero_first = ((size_t) old_index*p_alloc[0].page_size + head + p_alloc[0].page_size - 1) / p_alloc[0].page_size;
+    size_t zero_last = ((size_t) old_index*p_alloc[0].page_size + head + body) / p_alloc[0].page_size;
+    size_t i = pat_find_page(p_alloc[0].PAT, zero_first, zero_last, PAT_DIRTY);
+    while(i < zero_last) {
+        size_t dirty_pages = pat_extend_run(p_alloc[0].PAT, i, zero_last, PAT_DIRTY);
+        pat_set_range(p_alloc[0].PAT, i, i + dirty_pages, 0x00);
+        uncount_dirty_pages(p_alloc, dirty_pages);
+        i = pat_find_page(p_alloc[0].PAT, i + dirty_pages, zero_last, PAT_DIRTY);
+    }
+    new_ptr[0] = moved_ptr;
+    return true;
+}
+#endif
+
+static alloc_result resize_oldsize_zeroable_unlocked(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool allow_new_alignment, bool zero_new_pages, void** new_ptr) {
     if(p_alloc == NULL) {
         return INVALID_PARAMETER;
     }
@@ -248,26 +1503,26 @@ alloc_result resize_oldsize_zeroable(const allocator* p_alloc, void* old_ptr, si
         return INVALID_PARAMETER;
     }
     
-    /* we need to divide as floating point so we can round up */
-    size_t new_pages = (size_t) ceil(((float)new_size)/((float)p_alloc[0].page_size));
+    size_t new_pages = pages_for_size(p_alloc, new_size);
     if(new_pages > p_alloc[0].allocated_pages) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "Asked-for memory exceeds allocator memory pages!");
         return OUT_OF_MEMORY;
     }
     
-    int old_index = (((size_t)old_ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
-    if(old_index < 0 || old_index >= p_alloc[0].allocated_pages) {
+    if(((uint8_t*)old_ptr) < p_alloc[0].data || (((size_t)old_ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size >= p_alloc[0].allocated_pages) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "Pointer to be resized outside of memory pages!");
         return INVALID_ADDRESS;
     }
+    uint32_t old_index = (((size_t)old_ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
     
     
-    size_t old_pages;
-    alloc_result size_result = get_size(p_alloc, old_ptr, &old_pages);
+    size_t old_bytes;
+    alloc_result size_result = get_size_unlocked(p_alloc, old_ptr, &old_bytes);
     if(size_result != SUCCESS) return size_result;
+    size_t old_pages = old_bytes / p_alloc[0].page_size;
     
-    if(old_size != 0) {
-        size_t nominal_old_pages = (size_t) ceil(((float)old_size)/((float)p_alloc[0].page_size));
+    if(old_size != 0 && old_size != NO_OLD_SIZE_DATA) {
+        size_t nominal_old_pages = pages_for_size(p_alloc, old_size);
         if(nominal_old_pages > p_alloc[0].allocated_pages) {
             if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "Old given size for memory exceeds allocator memory pages!");
             return OUT_OF_MEMORY;
@@ -282,7 +1537,7 @@ alloc_result resize_oldsize_zeroable(const allocator* p_alloc, void* old_ptr, si
     if((alignment_bits != 0) && !alignment_satisfied(old_index, p_alloc[0].page_size, alignment_bits, offset_to_alignment, p_alloc[0].data)) {
         if(allow_new_alignment) {
             if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Due to alignment differences the new allocation will be handled by copying");
-            return resize_oldsize_zeroable_copy(p_alloc, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr);
+            return resize_oldsize_zeroable_copy_unlocked(p_alloc, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr);
         } else {
             if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "New alignment was given but not allowed!");
             return INVALID_ADDRESS;
@@ -291,82 +1546,79 @@ alloc_result resize_oldsize_zeroable(const allocator* p_alloc, void* old_ptr, si
     
     
     if(new_pages == old_pages) {
-        new_ptr[0} = old_ptr;
+        new_ptr[0] = old_ptr;
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Pointer resized to same page number size and returned without change");
         return SUCCESS;
     } else if (new_pages < old_pages) {
-        for(int i = old_index + new_pages; i < old_index + old_pages; i++) {
-            int old_value = p_alloc[0].PAT[i/4];
-            int new_state = 0x01;
-            int new_value = new_state << (i%4)*2;
-            int write_mask = (0x3 << (i%4)*2);
-            int old_mask = 0xFF - write_mask;
-            p_alloc[0].PAT[i/4] = (old_value&old_mask) | new_value;
-        }
+        release_pages(p_alloc, old_index + new_pages, old_index + old_pages);
+        p_alloc[0].run_pages[old_index] = new_pages;
+        new_ptr[0] = old_ptr;
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Pointer resized to a smaller page number size, old superfluous pages marked as freed");
         return SUCCESS;
-    } else if (new_pages > old_pages) {
-        bool enough_space_in_place = true;
-        for(int i = old_index + old_pages; i < old_index + new_pages; i++) {
-            int value = p_alloc[0].PAT[i/4];
-            int state = (old_value >> (i%4)*2) & 0x3;
-            if(state == 0x2 || state == 0x3) {
-                enough_space_in_place = false;
-                break;
-            }
-        }
+    } else {
+        size_t after_limit = (old_index + new_pages < p_alloc[0].allocated_pages) ? old_index + new_pages : p_alloc[0].allocated_pages;
+        size_t after = (old_index + old_pages < after_limit) ? pat_extend_run(p_alloc[0].PAT, old_index + old_pages, after_limit, PAT_FREE) : 0;
+        bool enough_space_in_place = (after == new_pages - old_pages);
         if(enough_space_in_place) {
             /* for zeroeing memory and setting the markings, we need to go through the array again, since the first round we couldn't know if the page gap was large enough: */
-            for(int i = old_index + old_pages; i < old_index + new_pages; i++) {
-                int old_value = p_alloc[0].PAT[i/4];
-                int old_state = (old_value >> (i%4)*2) & 0x3;
-                if(zeroed) {
-                    switch(old_state) {
-                        /* 00 */ case 0x00:
-                        break;
-                        /* 01 */ case 0x01:
-                            void* memset_return = memset(p_alloc[0].data[i*page_size], 0, page_size);
-                            if(memset_return != p_alloc) {
-                                if(log_function != NULL) log_function(REALLOCATION_ERROR, "Unknown error: memset returns wrong pointer!");
-                                return ERROR_UNKNOWN;
-                            }
-                        break;
-                        /* 10 */ case 0x02:
-                        /* 11 */ case 0x03:
-                            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "During zeroing of the memory reallocation the PAT appears to have been externally manipulated!");
-                            return ERROR_UNKNOWN;
-                        break;
-                    }
-                }
-                int new_value = 0x03 << (i%4)*2;
-                int write_mask = (0x3 << (i%4)*2);
-                int old_mask = 0xFF - write_mask;
-                p_alloc[0].PAT[i/4] = (old_value&old_mask) | new_value;
-            }
+            alloc_result claim_result = claim_pages(p_alloc, old_index + old_pages, old_index + new_pages, zero_new_pages, 0, REALLOCATION_ERROR);
+            if(claim_result != SUCCESS) return claim_result;
+            p_alloc[0].run_pages[old_index] = new_pages;
+            new_ptr[0] = old_ptr;
             if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Pointer resized to a bigger page number size, new pages marked as allocated");
             return SUCCESS;
+        }
+#if defined(ALLOC_HAVE_MMAP) && defined(MREMAP_DONTUNMAP)
+        if(remap_grow(p_alloc, old_ptr, old_index, old_pages, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr)) {
+            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Pointer resized to a bigger page number size by remapping its pages");
+            return SUCCESS;
+        }
+#endif
+        size_t prefix = new_pages - old_pages - after;
+        bool enough_space_around = (pat_free_run_before(p_alloc[0].PAT, old_index) >= prefix)
+            && (alignment_bits == 0 || alignment_satisfied(old_index - prefix, p_alloc[0].page_size, alignment_bits, offset_to_alignment, p_alloc[0].data));
+        if(enough_space_around) {
+            alloc_result grow_result = grow_into_prefix(p_alloc, old_ptr, old_index, old_pages, new_pages, after, zero_new_pages, new_ptr);
+            if(grow_result != SUCCESS) return grow_result;
+            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Pointer resized to a bigger page number size, data moved down into the free pages before it");
+            return SUCCESS;
         } else {
             if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Due to size limitations the new allocation will be handled by copying");
-            return resize_oldsize_zeroable_copy(p_alloc, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr);
+            return resize_oldsize_zeroable_copy_unlocked(p_alloc, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr);
         }
     }
 }
 
-alloc_result resize_oldsize_zeroable_copy(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr) {
-    alloc_result new_address_result = alloc_align_offset_zeroable(p_alloc, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr);
+static alloc_result resize_oldsize_zeroable_copy_unlocked(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(new_ptr == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "Out-pointer to store memory pointer is NULL!");
+        return INVALID_PARAMETER;
+    }
+    size_t old_bytes;
+    alloc_result size_result = get_size_unlocked(p_alloc, old_ptr, &old_bytes);
+    if(size_result != SUCCESS) return size_result;
+    
+    void* moved_ptr;
+    alloc_result new_address_result = alloc_align_offset_zeroable_unlocked(p_alloc, new_size, alignment_bits, offset_to_alignment, zero_new_pages, &moved_ptr);
     if(new_address_result != SUCCESS) return new_address_result;
-    if(memmove(new_ptr, old_ptr, min(old_size, new_size)) != new_ptr) {
+    COUNT_RESIZE_BYTES(p_alloc[0].stats, (old_bytes < new_size) ? old_bytes : new_size, 0);
+    if(memmove(moved_ptr, old_ptr, (old_bytes < new_size) ? old_bytes : new_size) != moved_ptr) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "Unknown memmove error, where it returned a different pointer than expected");
         return ERROR_UNKNOWN;
     }
-    alloc_result free_result = free_size(p_alloc, old_ptr, old_size);
+    alloc_result free_result = free_size_unlocked(p_alloc, old_ptr, old_size);
     if(free_result != SUCCESS) return free_result;
     
+    new_ptr[0] = moved_ptr;
     if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Reallocation by copying was successful");
     return SUCCESS;
 }
 
-alloc_result free_size(const allocator* p_alloc, void* ptr, size_t old_size) {
+/* checks that ptr is the start of an allocation of old_size bytes (if given) and returns its first page and page count */
+static alloc_result validate_free(const allocator* p_alloc, void* ptr, size_t old_size, uint32_t *out_index, size_t *out_pages) {
     if(p_alloc == NULL) {
         return INVALID_PARAMETER;
     }
@@ -376,18 +1628,19 @@ alloc_result free_size(const allocator* p_alloc, void* ptr, size_t old_size) {
     }
     
     
-    int old_index = (((size_t)old_ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
-    if(old_index < 0 || old_index >= p_alloc[0].allocated_pages) {
+    if(((uint8_t*)ptr) < p_alloc[0].data || (((size_t)ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size >= p_alloc[0].allocated_pages) {
         if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_ERROR, "Pointer to be freed outside of memory pages!");
         return INVALID_ADDRESS;
     }
+    uint32_t old_index = (((size_t)ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
     
-    size_t old_pages;
-    alloc_result size_result = get_size(p_alloc, old_ptr, &old_pages);
+    size_t old_bytes;
+    alloc_result size_result = get_size_unlocked(p_alloc, ptr, &old_bytes);
     if(size_result != SUCCESS) return size_result;
+    size_t old_pages = old_bytes / p_alloc[0].page_size;
     
-    if(old_size != 0) {
-        size_t nominal_old_pages = (size_t) ceil(((float)old_size)/((float)p_alloc[0].page_size));
+    if(old_size != 0 && old_size != NO_OLD_SIZE_DATA) {
+        size_t nominal_old_pages = pages_for_size(p_alloc, old_size);
         if(nominal_old_pages > p_alloc[0].allocated_pages) {
             if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_ERROR, "Old given size for memory exceeds allocator memory pages!");
             return OUT_OF_MEMORY;
@@ -398,16 +1651,856 @@ alloc_result free_size(const allocator* p_alloc, void* ptr, size_t old_size) {
         }
     }
     
+    out_index[0] = old_index;
+    out_pages[0] = old_pages;
+    return SUCCESS;
+}
+
+static alloc_result free_size_unlocked(const allocator* p_alloc, void* ptr, size_t old_size) {
+    uint32_t old_index;
+    size_t old_pages;
+    alloc_result validate_result = validate_free(p_alloc, ptr, old_size, &old_index, &old_pages);
+    if(validate_result != SUCCESS) return validate_result;
     
-    for(int i = old_index; i < old_index + old_pages; i++) {
-        int old_value = p_alloc[0].PAT[i/4];
-        int new_state = 0x01;
-        int new_value = new_state << (i%4)*2;
-        int write_mask = (0x3 << (i%4)*2);
-        int old_mask = 0xFF - write_mask;
-        p_alloc[0].PAT[i/4] = (old_value&old_mask) | new_value;
+    release_pages(p_alloc, old_index, old_index + old_pages);
+    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_SUCCESS, "Pointer deallocated, old pages marked as freed");
+    return SUCCESS;
+}
+
+static alloc_result relocate_lower_unlocked(const allocator* p_alloc, void* old_ptr, void** new_ptr) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(new_ptr == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_ERROR, "Out-pointer to store memory pointer is NULL!");
+        return INVALID_PARAMETER;
+    }
+    size_t old_bytes;
+    alloc_result size_result = get_size_unlocked(p_alloc, old_ptr, &old_bytes);
+    if(size_result != SUCCESS) return size_result;
+    uint32_t old_index = (((size_t)old_ptr) - ((size_t)p_alloc[0].data))/p_alloc[0].page_size;
+    uint32_t pages = old_bytes / p_alloc[0].page_size;
+
+    uint32_t fit;
+    if(find_free_run(p_alloc, pages, &fit) && fit < old_index) {
+        /* a free run below that holds the whole allocation, so nothing overlaps */
+        alloc_result claim_result = claim_pages(p_alloc, fit, fit + pages, false, pages, REALLOCATION_ERROR);
+        if(claim_result != SUCCESS) return claim_result;
+        memcpy(&(p_alloc[0].data[(size_t) fit*p_alloc[0].page_size]), old_ptr, old_bytes);
+        release_pages(p_alloc, old_index, old_index + pages);
+    } else {
+        /* slide down over the free pages right below, fewer than the allocation has (or first fit would have
+           found them): those become its head and the pages its tail leaves behind are freed */
+        uint32_t below = pat_free_run_before(p_alloc[0].PAT, old_index);
+        if(below == 0) {
+            new_ptr[0] = old_ptr;
+            return SUCCESS;
+        }
+        fit = old_index - below;
+        memmove(&(p_alloc[0].data[(size_t) fit*p_alloc[0].page_size]), old_ptr, old_bytes);
+        alloc_result claim_result = claim_pages(p_alloc, fit, old_index, false, pages, REALLOCATION_ERROR);
+        if(claim_result != SUCCESS) return claim_result;
+        pat_set_range(p_alloc[0].PAT, old_index, old_index + 1, 0x03);
+        COUNT_USED_PAGES(p_alloc, -1, 0);
+        release_pages(p_alloc, fit + pages, old_index + pages);
+    }
+
+    new_ptr[0] = &(p_alloc[0].data[(size_t) fit*p_alloc[0].page_size]);
+    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(REALLOCATION_SUCCESS, "Allocation moved to lower pages");
+    return SUCCESS;
+}
+
+static alloc_result alloc_batch_unlocked(const allocator* p_alloc, size_t size, uint32_t count, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptrs) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(out_ptrs == NULL || size == 0 || count == 0) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "Attempt to allocate a batch of 0 bytes, 0 allocations or without out-pointers!");
+        return INVALID_PARAMETER;
+    }
+    
+    size_t used_pages = pages_for_size(p_alloc, size);
+    if(used_pages > p_alloc[0].allocated_pages) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "Asked-for memory exceeds allocator memory pages!");
+        return OUT_OF_MEMORY;
+    }
+    
+    /* one pass over the free runs, each carved into as many allocations as fit, records their starts in out_ptrs;
+       with alignment, allocations start at the aligned pages only. All or nothing: only once the whole batch is
+       found is every stretch of consecutive allocations claimed (zeroed, marked and indexed) at once */
+    uint64_t aligned_first = 0, aligned_stride = 1;
+    if(alignment_bits != 0 && !aligned_pages(p_alloc, alignment_bits, offset_to_alignment, &aligned_first, &aligned_stride)) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "No page of the allocator can satisfy the alignment");
+        return OUT_OF_MEMORY;
+    }
+    uint32_t done = 0;
+    size_t run_start = pat_find_page(p_alloc[0].PAT, 0, p_alloc[0].allocated_pages, PAT_FREE);
+    while(done < count && run_start < p_alloc[0].allocated_pages) {
+        size_t run_end = run_start + pat_extend_run(p_alloc[0].PAT, run_start, p_alloc[0].allocated_pages, PAT_FREE);
+        size_t i = (alignment_bits != 0) ? next_aligned_page(run_start, aligned_first, aligned_stride) : run_start;
+        while(done < count && i + used_pages <= run_end) {
+            out_ptrs[done++] = &(p_alloc[0].data[i*p_alloc[0].page_size]);
+            i += used_pages;
+            if(alignment_bits != 0) i = next_aligned_page(i, aligned_first, aligned_stride);
+        }
+        run_start = pat_find_page(p_alloc[0].PAT, run_end, p_alloc[0].allocated_pages, PAT_FREE);
+    }
+    if(done < count) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_ERROR, "The allocator has no area available for the whole batch due to use or fragmentation");
+        return OUT_OF_MEMORY;
+    }
+    
+    size_t allocation_bytes = used_pages*p_alloc[0].page_size;
+    for(uint32_t j = 0; j < count; ) {
+        uint32_t stretch = 1;
+        while(j + stretch < count && (uint8_t*) out_ptrs[j + stretch] == (uint8_t*) out_ptrs[j] + stretch*allocation_bytes) stretch++;
+        size_t first = ((uint8_t*) out_ptrs[j] - p_alloc[0].data) / p_alloc[0].page_size;
+        alloc_result claim_result = claim_pages(p_alloc, first, first + stretch*used_pages, zeroed, used_pages, ALLOCATION_ERROR);
+        if(claim_result != SUCCESS) return claim_result;
+        j += stretch;
+    }
+    
+    COUNT_REQUESTS(p_alloc[0].stats, count, size, used_pages*p_alloc[0].page_size);
+    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_SUCCESS, "Successfully allocated a batch of memory allocations");
+    return SUCCESS;
+}
+
+static bool alignment_satisfied(uint32_t i, uint32_t page_size, int alignment_bits, size_t offset_to_alignment, uint8_t *data);
+
+#ifdef ALLOC_HAVE_PTHREADS
+/* serves an allocation from the calling thread's cache shard if it holds a run of exactly used_pages pages */
+static bool take_cached_run(const allocator* p_alloc, size_t size, size_t used_pages, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
+    cache_shard *shard = own_shard(p_alloc);
+    lock_shard(shard);
+    for(uint32_t j = shard->count; j-- > 0; ) {
+        if(shard->pages[j] != used_pages) continue;
+        uint32_t first_page = shard->first_page[j];
+        if(alignment_bits != 0 && !alignment_satisfied(first_page, p_alloc[0].page_size, alignment_bits, offset_to_alignment, p_alloc[0].data)) continue;
+        shard->count--;
+        shard->first_page[j] = shard->first_page[shard->count];
+        shard->pages[j] = shard->pages[shard->count];
+        clear_cached(p_alloc, first_page);
+        /* cached runs keep whatever their last owner wrote */
+        if(zeroed) {
+            shard->stats.zeroed_allocations_memset++;
+            shard->stats.pages_memset += used_pages;
+        }
+        COUNT_REQUESTS(&(shard->stats), 1, size, used_pages*p_alloc[0].page_size);
+        unlock_shard(shard);
+        out_ptr[0] = &(p_alloc[0].data[(size_t) first_page*p_alloc[0].page_size]);
+        if(zeroed) memset(out_ptr[0], 0, used_pages*p_alloc[0].page_size);
+        return true;
+    }
+    unlock_shard(shard);
+    return false;
+}
+
+/* parks a freed run in the calling thread's cache shard; when the shard is full, its older half goes back to the shared pages */
+static void put_cached_run(const allocator* p_alloc, uint32_t first_page, uint32_t pages) {
+    uint32_t evicted_first[CACHE_RUNS_PER_SHARD/2];
+    uint32_t evicted_pages[CACHE_RUNS_PER_SHARD/2];
+    uint32_t evicted = 0;
+    cache_shard *shard = own_shard(p_alloc);
+    lock_shard(shard);
+    if(shard->count == CACHE_RUNS_PER_SHARD) {
+        evicted = CACHE_RUNS_PER_SHARD/2;
+        memcpy(evicted_first, shard->first_page, sizeof(evicted_first));
+        memcpy(evicted_pages, shard->pages, sizeof(evicted_pages));
+        memmove(shard->first_page, &(shard->first_page[evicted]), (shard->count - evicted)*sizeof(uint32_t));
+        memmove(shard->pages, &(shard->pages[evicted]), (shard->count - evicted)*sizeof(uint32_t));
+        shard->count -= evicted;
+    }
+    shard->first_page[shard->count] = first_page;
+    shard->pages[shard->count] = pages;
+    shard->count++;
+    unlock_shard(shard);
+    
+    if(evicted != 0) {
+        lock_shared(p_alloc);
+        for(uint32_t j = 0; j < evicted; j++) {
+            clear_cached(p_alloc, evicted_first[j]);
+            release_pages(p_alloc, evicted_first[j], evicted_first[j] + evicted_pages[j]);
+        }
+        unlock_shared(p_alloc);
+    }
+}
+#endif
+
+alloc_result alloc_align_offset_zeroable(const allocator* p_alloc, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
+#ifdef ALLOC_HAVE_PTHREADS
+    if(p_alloc != NULL && uses_thread_caches(p_alloc) && out_ptr != NULL && size != 0) {
+        TRACE_BEGIN(p_alloc, NULL);
+        size_t used_pages = pages_for_size(p_alloc, size);
+        if(used_pages <= CACHE_MAX_RUN_PAGES && take_cached_run(p_alloc, size, used_pages, alignment_bits, offset_to_alignment, zeroed, out_ptr)) {
+            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(ALLOCATION_SUCCESS, "Successfully allocated memory");
+            TRACE_TAKEN(p_alloc, size, alignment_bits, zeroed, (uint32_t) (((uint8_t*) out_ptr[0] - p_alloc[0].data) / p_alloc[0].page_size), (uint32_t) used_pages);
+            return SUCCESS;
+        }
+    }
+#endif
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, NULL);
+    alloc_result result = alloc_align_offset_zeroable_unlocked(p_alloc, size, alignment_bits, offset_to_alignment, zeroed, out_ptr);
+#ifdef ALLOC_HAVE_PTHREADS
+    if(result == OUT_OF_MEMORY && uses_thread_caches(p_alloc)) {
+        /* the pages might just be sitting in the caches of other threads */
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Retrying the allocation after flushing the thread caches");
+        flush_caches_locked(p_alloc);
+        result = alloc_align_offset_zeroable_unlocked(p_alloc, size, alignment_bits, offset_to_alignment, zeroed, out_ptr);
+    }
+#endif
+    TRACE_END(p_alloc, TRACE_ALLOC, result, size, alignment_bits, zeroed, (result == SUCCESS) ? out_ptr[0] : NULL);
+    purge_in_background(p_alloc);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+alloc_result resize_oldsize_zeroable(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool allow_new_alignment, bool zero_new_pages, void** new_ptr) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, old_ptr);
+    alloc_result result = resize_oldsize_zeroable_unlocked(p_alloc, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, allow_new_alignment, zero_new_pages, new_ptr);
+    TRACE_END(p_alloc, TRACE_RESIZE, result, new_size, alignment_bits, zero_new_pages, (result == SUCCESS) ? new_ptr[0] : NULL);
+    purge_in_background(p_alloc);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+alloc_result resize_oldsize_zeroable_copy(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, old_ptr);
+    alloc_result result = resize_oldsize_zeroable_copy_unlocked(p_alloc, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, zero_new_pages, new_ptr);
+    TRACE_END(p_alloc, TRACE_RESIZE, result, new_size, alignment_bits, zero_new_pages, (result == SUCCESS) ? new_ptr[0] : NULL);
+    purge_in_background(p_alloc);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+alloc_result free_size(const allocator* p_alloc, void* ptr, size_t old_size) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(!uses_thread_caches(p_alloc)) {
+        lock_shared(p_alloc);
+        TRACE_BEGIN(p_alloc, ptr);
+        alloc_result result = free_size_unlocked(p_alloc, ptr, old_size);
+        TRACE_END(p_alloc, TRACE_FREE, result, 0, 0, false, NULL);
+        purge_in_background(p_alloc);
+        unlock_shared(p_alloc);
+        return result;
+    }
+#ifdef ALLOC_HAVE_PTHREADS
+    /* validated under the lock, as other threads write the PAT and run lengths around the allocation; a small run
+       is flagged as cached before the lock is dropped, so that a second free of it is rejected */
+    uint32_t old_index;
+    size_t old_pages;
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, NULL);
+    alloc_result validate_result = validate_free(p_alloc, ptr, old_size, &old_index, &old_pages);
+    if(validate_result != SUCCESS) {
+        TRACE_END(p_alloc, TRACE_FREE, validate_result, 0, 0, false, NULL);
+        unlock_shared(p_alloc);
+        return validate_result;
+    }
+    /* recorded before the pages are released, so that no allocation of them can be recorded ahead of it */
+    TRACE_FREED(p_alloc, old_index, (uint32_t) old_pages);
+    
+    if(old_pages <= CACHE_MAX_RUN_PAGES) {
+        set_cached(p_alloc, old_index);
+        unlock_shared(p_alloc);
+        put_cached_run(p_alloc, old_index, old_pages);
+    } else {
+        release_pages(p_alloc, old_index, old_index + old_pages);
+        purge_in_background(p_alloc);
+        unlock_shared(p_alloc);
     }
     if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_SUCCESS, "Pointer deallocated, old pages marked as freed");
+#endif
     return SUCCESS;
 }
 
+alloc_result alloc_batch(const allocator* p_alloc, size_t size, uint32_t count, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptrs) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, NULL);
+    alloc_result result = alloc_batch_unlocked(p_alloc, size, count, alignment_bits, offset_to_alignment, zeroed, out_ptrs);
+#ifdef ALLOC_HAVE_PTHREADS
+    if(result == OUT_OF_MEMORY && uses_thread_caches(p_alloc)) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Retrying the batch allocation after flushing the thread caches");
+        flush_caches_locked(p_alloc);
+        result = alloc_batch_unlocked(p_alloc, size, count, alignment_bits, offset_to_alignment, zeroed, out_ptrs);
+    }
+#endif
+#ifdef ALLOC_TRACE
+    if(result != SUCCESS) TRACE_END(p_alloc, TRACE_ALLOC, result, size, alignment_bits, zeroed, NULL);
+    for(uint32_t j = 0; result == SUCCESS && j < count; j++) TRACE_END(p_alloc, TRACE_ALLOC, result, size, alignment_bits, zeroed, out_ptrs[j]);
+#endif
+    purge_in_background(p_alloc);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+alloc_result free_batch(const allocator* p_alloc, void** ptrs, uint32_t count) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(ptrs == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_ERROR, "Array of pointers to be freed is NULL!");
+        return INVALID_PARAMETER;
+    }
+    
+    /* batches bypass the thread caches and go straight back to the shared pages; adjacent allocations, as
+       alloc_batch hands them out, are released together as one range */
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, NULL);
+    uint32_t pending_first = 0, pending_last = 0;
+    alloc_result result = SUCCESS;
+    for(uint32_t j = 0; j < count; j++) {
+        uint32_t index;
+        size_t pages;
+        result = validate_free(p_alloc, ptrs[j], NO_OLD_SIZE_DATA, &index, &pages);
+        if(result != SUCCESS) break;
+        if(index >= pending_first && index < pending_last) {
+            if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_ERROR, "Pointer appears twice in the batch to be freed!");
+            result = INVALID_ADDRESS;
+            break;
+        }
+        if(index != pending_last) {
+            if(pending_last != pending_first) release_pages(p_alloc, pending_first, pending_last);
+            pending_first = index;
+        }
+        pending_last = index + pages;
+        TRACE_FREED(p_alloc, index, (uint32_t) pages);
+    }
+    if(pending_last != pending_first) release_pages(p_alloc, pending_first, pending_last);
+    
+    if(result == SUCCESS && p_alloc[0].log_function != NULL) p_alloc[0].log_function(DEALLOCATION_SUCCESS, "Batch of pointers deallocated, old pages marked as freed");
+    purge_in_background(p_alloc);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+alloc_result relocate_lower(const allocator* p_alloc, void* old_ptr, void** new_ptr) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    TRACE_BEGIN(p_alloc, old_ptr);
+    alloc_result result = relocate_lower_unlocked(p_alloc, old_ptr, new_ptr);
+    TRACE_END(p_alloc, TRACE_RELOCATE, result, 0, 0, false, (result == SUCCESS) ? new_ptr[0] : NULL);
+    purge_in_background(p_alloc);
+    unlock_shared(p_alloc);
+    return result;
+}
+
+alloc_result flush_thread_caches(const allocator* p_alloc) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+#ifdef ALLOC_HAVE_PTHREADS
+    if(uses_thread_caches(p_alloc)) {
+        lock_shared(p_alloc);
+        flush_caches_locked(p_alloc);
+        unlock_shared(p_alloc);
+    }
+#endif
+    return SUCCESS;
+}
+
+alloc_result prezero_freed_pages(const allocator* p_alloc, uint32_t max_pages, uint32_t* out_zeroed_pages) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    
+    lock_shared(p_alloc);
+    uint32_t zeroed_pages = 0;
+    size_t i = pat_find_page(p_alloc[0].PAT, 0, p_alloc[0].allocated_pages, PAT_DIRTY);
+    while(i < p_alloc[0].allocated_pages && zeroed_pages < max_pages) {
+        size_t dirty_pages = pat_extend_run(p_alloc[0].PAT, i, p_alloc[0].allocated_pages, PAT_DIRTY);
+        if(dirty_pages > max_pages - zeroed_pages) dirty_pages = max_pages - zeroed_pages;
+        uint32_t zero_first = i, zero_last = i;
+#ifdef ALLOC_HAVE_MMAP
+        /* on the mmap backend the kernel can zero whole OS pages for us without touching them */
+        if(p_alloc[0].backend != BACKEND_CALLOC) discard_pages(p_alloc, i, i + dirty_pages, &zero_first, &zero_last);
+#endif
+        if(zero_first > i) memset(&(p_alloc[0].data[i*p_alloc[0].page_size]), 0, (zero_first - i)*p_alloc[0].page_size);
+        if(zero_last < i + dirty_pages) memset(&(p_alloc[0].data[(size_t) zero_last*p_alloc[0].page_size]), 0, (i + dirty_pages - zero_last)*p_alloc[0].page_size);
+        pat_set_range(p_alloc[0].PAT, i, i + dirty_pages, 0x00);
+        uncount_dirty_pages(p_alloc, dirty_pages);
+        zeroed_pages += dirty_pages;
+        i = pat_find_page(p_alloc[0].PAT, i + dirty_pages, p_alloc[0].allocated_pages, PAT_DIRTY);
+    }
+    p_alloc[0].stats->pages_prezeroed += zeroed_pages;
+    unlock_shared(p_alloc);
+    
+    if(out_zeroed_pages != NULL) out_zeroed_pages[0] = zeroed_pages;
+    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Freed pages zeroed ahead of allocation");
+    return SUCCESS;
+}
+
+alloc_result purge_freed_pages(const allocator* p_alloc, uint32_t max_pages, uint32_t* out_purged_pages) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(p_alloc[0].backend == BACKEND_CALLOC) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Purging freed pages needs the mmap backend!");
+        return INVALID_PARAMETER;
+    }
+    uint32_t purged_pages = 0;
+#ifdef ALLOC_HAVE_MMAP
+    lock_shared(p_alloc);
+    /* a sweep of its own, which also completes a purge under way in the background */
+    bool round_done;
+    p_alloc[0].purge->swept_pages = 0;
+    purged_pages = purge_step(p_alloc, max_pages, 0, &round_done);
+    if(round_done) {
+        p_alloc[0].purge->goal = PURGE_IDLE;
+        p_alloc[0].purge->rearm_pages = 0;
+    }
+    unlock_shared(p_alloc);
+#endif
+    
+    if(out_purged_pages != NULL) out_purged_pages[0] = purged_pages;
+    if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Freed pages returned to the system");
+    return SUCCESS;
+}
+
+alloc_result get_allocator_stats(const allocator* p_alloc, allocator_stats* out_stats) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(out_stats == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Out-pointer to store the statistics is NULL!");
+        return INVALID_PARAMETER;
+    }
+    lock_shared(p_alloc);
+    out_stats[0] = p_alloc[0].stats[0];
+#ifndef ALLOC_NO_STATS
+    out_stats[0].pages_free_dirty = p_alloc[0].purge->dirty_pages;
+    out_stats[0].pages_continuation = out_stats[0].used_pages - out_stats[0].live_allocations;
+    out_stats[0].pages_free_zeroed = p_alloc[0].allocated_pages - out_stats[0].used_pages - out_stats[0].pages_free_dirty;
+#endif
+    unlock_shared(p_alloc);
+    add_cache_stats(p_alloc, out_stats);
+    return SUCCESS;
+}
+
+alloc_result get_heap_map(const allocator* p_alloc, allocator_heap_map* out_map) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(out_map == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Out-pointer to store the heap map is NULL!");
+        return INVALID_PARAMETER;
+    }
+    memset(out_map, 0, sizeof(allocator_heap_map));
+    lock_shared(p_alloc);
+    uint32_t total = p_alloc[0].allocated_pages;
+    size_t i = pat_find_page(p_alloc[0].PAT, 0, total, PAT_FREE);
+    while(i < total) {
+        size_t length = pat_extend_run(p_alloc[0].PAT, i, total, PAT_FREE);
+        int k = 0;
+        while(k + 1 < ALLOC_HEAP_MAP_CLASSES && (length >> (k + 1)) != 0) k++;
+        out_map->free_runs[k]++;
+        out_map->free_run_count++;
+        out_map->free_pages += length;
+        if(length > out_map->largest_free_run) out_map->largest_free_run = (uint32_t) length;
+        /* the page after a free run is used, so the next search can start behind it */
+        i = pat_find_page(p_alloc[0].PAT, i + length, total, PAT_FREE);
+    }
+    unlock_shared(p_alloc);
+    return SUCCESS;
+}
+
+#ifdef ALLOC_TRACE
+alloc_result read_allocator_trace(const allocator* p_alloc, uint64_t* cursor, alloc_trace_record* records, uint32_t max_records, uint32_t* out_count, uint64_t* out_lost) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(cursor == NULL || records == NULL || out_count == NULL || p_alloc[0].trace == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Cursor, record array or out-pointer is NULL, or tracing is off!");
+        return INVALID_PARAMETER;
+    }
+    struct alloc_trace *trace = p_alloc[0].trace;
+    uint64_t next = atomic_load_explicit(&(trace->next), memory_order_acquire);
+    uint64_t n = cursor[0];
+    uint64_t lost = 0;
+    if(next > ALLOC_TRACE_RECORDS && n < next - ALLOC_TRACE_RECORDS) {
+        lost += next - ALLOC_TRACE_RECORDS - n;
+        n = next - ALLOC_TRACE_RECORDS;
+    }
+    uint32_t count = 0;
+    for(; n < next && count < max_records; n++) {
+        struct alloc_trace_slot *slot = &(trace->slots[n & (ALLOC_TRACE_RECORDS - 1)]);
+        uint64_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+        /* a record still being written ends the read, the next one continues with it */
+        if(sequence < 2*n + 2) break;
+        if(sequence == 2*n + 2) {
+            uint64_t words[TRACE_RECORD_WORDS];
+            for(size_t w = 0; w < TRACE_RECORD_WORDS; w++) words[w] = atomic_load_explicit(&(slot->record[w]), memory_order_relaxed);
+            memcpy(&(records[count]), words, sizeof(words));
+            atomic_thread_fence(memory_order_acquire);
+            if(atomic_load_explicit(&(slot->sequence), memory_order_relaxed) == sequence) {
+                count++;
+                continue;
+            }
+        }
+        lost++;
+    }
+    cursor[0] = n;
+    out_count[0] = count;
+    if(out_lost != NULL) out_lost[0] = lost;
+    return SUCCESS;
+}
+
+alloc_result dump_allocator_trace(const allocator* p_alloc, const char* path) {
+    if(p_alloc == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(path == NULL || p_alloc[0].trace == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Path for the trace dump is NULL, or tracing is off!");
+        return INVALID_PARAMETER;
+    }
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Could not open the file for the trace dump");
+        return INVALID_PARAMETER;
+    }
+    alloc_trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ALLOC_TRACE_MAGIC, sizeof(header.magic));
+    header.record_bytes = sizeof(alloc_trace_record);
+    header.page_size = p_alloc[0].page_size;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    /* everything recorded up to now; records written meanwhile are left for the next dump */
+    alloc_trace_record records[256];
+    uint64_t cursor = 0;
+    uint64_t end = atomic_load_explicit(&(p_alloc[0].trace->next), memory_order_acquire);
+    while(written && cursor < end) {
+        uint32_t count;
+        uint64_t lost;
+        uint64_t left = end - cursor;
+        read_allocator_trace(p_alloc, &cursor, records, (left < 256) ? (uint32_t) left : 256, &count, &lost);
+        header.lost_records += lost;
+        header.record_count += count;
+        if(count == 0 && lost == 0) break;
+        written = fwrite(records, sizeof(alloc_trace_record), count, file) == count;
+    }
+    written = written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if(fclose(file) != 0 || !written) {
+        if(p_alloc[0].log_function != NULL) p_alloc[0].log_function(NOTE, "Could not write the trace dump");
+        return ERROR_UNKNOWN;
+    }
+    return SUCCESS;
+}
+#endif
+
+
+/* shared allocators: the mapping of fd starts with a header, followed by everything that init_allocator_options
+   would allocate privately (PAT, run length table, nodes of the free-run index, stats, purge state, lock and thread
+   caches) and then the data. All of it is addressed by offsets from the header, so every process can map it
+   anywhere; only the free_run_index struct pointing at the nodes is per process. */
+
+#ifdef ALLOC_HAVE_PTHREADS
+#define SHARED_MAGIC 0x3130434f4c4c4150ULL  /* "PALLOC01" */
+#define SHARED_VERSION 3
+#define BOOT_ID_BYTES 40
+
+struct shared_header {
+    uint64_t magic;          /* written last by init_allocator_shared, so a half made region is never attached */
+    uint32_t version;
+    uint32_t header_bytes;   /* sizeof(struct shared_header) of the creator, as a check for matching builds */
+    uint32_t page_size;
+    uint32_t allocated_pages;
+    uint32_t zeroing;
+    uint32_t placement;
+    uint32_t leaf_count;
+    uint64_t region_bytes;
+    uint64_t PAT_offset;
+    uint64_t run_pages_offset;
+    uint64_t nodes_offset;
+    uint64_t stats_offset;
+    uint64_t purge_offset;
+    uint64_t sync_offset;
+    uint64_t data_offset;
+    _Atomic uint64_t root;
+    char boot_id[BOOT_ID_BYTES];  /* of the boot the lock was last initialized in */
+};
+
+static size_t round_up(size_t value, size_t unit) {
+    return ((value + unit - 1) / unit) * unit;
+}
+
+/* fills in the sizes and offsets of the header for page_number pages of page_size bytes */
+static void shared_layout(uint32_t page_size, uint32_t page_number, struct shared_header *layout) {
+    uint32_t blocks = (page_number + PAGES_PER_BLOCK - 1) / PAGES_PER_BLOCK;
+    uint32_t leaf_count = 1;
+    while(leaf_count < blocks) leaf_count *= 2;
+    layout->header_bytes = sizeof(struct shared_header);
+    layout->page_size = page_size;
+    layout->allocated_pages = page_number;
+    layout->leaf_count = leaf_count;
+    size_t offset = round_up(sizeof(struct shared_header), 64);
+    layout->PAT_offset = offset;
+    offset = round_up(offset + PAT_bytes(page_number), 64);
+    layout->run_pages_offset = offset;
+    offset = round_up(offset + PAT_bytes(page_number)*4*sizeof(uint32_t), 64);
+    layout->nodes_offset = offset;
+    offset = round_up(offset + 2*(size_t) leaf_count*sizeof(free_run_node), 64);
+    layout->stats_offset = offset;
+    offset = round_up(offset + sizeof(allocator_stats), 64);
+    layout->purge_offset = offset;
+    offset = round_up(offset + sizeof(struct allocator_purge), 64);
+    layout->sync_offset = offset;
+    offset = round_up(offset + sizeof(struct allocator_sync), 64);
+    layout->data_offset = round_up(offset, os_page_size());
+    layout->region_bytes = round_up(layout->data_offset + (size_t) page_number*page_size, os_page_size());
+}
+
+static void read_boot_id(char *out_boot_id) {
+    memset(out_boot_id, 0, BOOT_ID_BYTES);
+    FILE *file = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if(file == NULL) return;
+    if(fgets(out_boot_id, BOOT_ID_BYTES, file) != NULL) out_boot_id[strcspn(out_boot_id, "\n")] = 0;
+    fclose(file);
+}
+
+static size_t shared_region_bytes(const allocator* p_alloc) {
+    return p_alloc[0].shared->region_bytes;
+}
+
+/* points out_alloc at the parts of the mapping that starts with header */
+static alloc_result view_shared_allocator(struct shared_header *header, PFN_alloc_log log_function, allocator* out_alloc) {
+    uint8_t *base = (uint8_t*) header;
+    memset(out_alloc, 0, sizeof(allocator));
+    out_alloc[0].free_runs = calloc(1,sizeof(struct free_run_index));
+    if(out_alloc[0].free_runs == NULL) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Ran out of system memory when trying to allocate the free-run index");
+        return OUT_OF_MEMORY;
+    }
+    out_alloc[0].free_runs->leaf_count = header->leaf_count;
+    out_alloc[0].free_runs->nodes = (free_run_node*) (base + header->nodes_offset);
+    out_alloc[0].page_size = header->page_size;
+    out_alloc[0].allocated_pages = header->allocated_pages;
+    out_alloc[0].PAT = base + header->PAT_offset;
+    out_alloc[0].run_pages = (uint32_t*) (base + header->run_pages_offset);
+    out_alloc[0].data = base + header->data_offset;
+    out_alloc[0].log_function = log_function;
+    out_alloc[0].backend = BACKEND_SHARED;
+    out_alloc[0].reserved_pages = header->allocated_pages;
+    out_alloc[0].zeroing = (allocator_zeroing) header->zeroing;
+    out_alloc[0].placement = (allocator_placement) header->placement;
+    out_alloc[0].huge_pages = HUGE_PAGES_NONE;
+    out_alloc[0].commit_bytes = os_page_size();
+    out_alloc[0].stats = (allocator_stats*) (base + header->stats_offset);
+    out_alloc[0].purge = (struct allocator_purge*) (base + header->purge_offset);
+    out_alloc[0].sync = (struct allocator_sync*) (base + header->sync_offset);
+    out_alloc[0].shared = header;
+    return SUCCESS;
+}
+
+/* rebuilds what the PAT determines: the free-run index and the counts of 01 pages, used pages and allocations */
+static void recover_shared_state(const allocator* p_alloc) {
+    build_free_run_index(p_alloc);
+    struct allocator_purge *purge = p_alloc[0].purge;
+    purge->dirty_pages = 0;
+    size_t i = pat_find_page(p_alloc[0].PAT, 0, p_alloc[0].allocated_pages, PAT_DIRTY);
+    while(i < p_alloc[0].allocated_pages) {
+        size_t dirty_pages = pat_extend_run(p_alloc[0].PAT, i, p_alloc[0].allocated_pages, PAT_DIRTY);
+        purge->dirty_pages += dirty_pages;
+        i = pat_find_page(p_alloc[0].PAT, i + dirty_pages, p_alloc[0].allocated_pages, PAT_DIRTY);
+    }
+    purge->goal = PURGE_IDLE;
+    purge->deadline_ns = (purge->dirty_pages != 0 && purge->decay_ns != 0) ? monotonic_ns() + purge->decay_ns : 0;
+#ifndef ALLOC_NO_STATS
+    allocator_stats *stats = p_alloc[0].stats;
+    uint32_t total = p_alloc[0].allocated_pages;
+    stats->used_pages = 0;
+    stats->live_allocations = 0;
+    size_t used_first = pat_extend_run(p_alloc[0].PAT, 0, total, PAT_FREE);
+    while(used_first < total) {
+        size_t used_last = pat_find_page(p_alloc[0].PAT, used_first, total, PAT_FREE);
+        stats->used_pages += used_last - used_first;
+        stats->live_allocations += allocations_in(p_alloc, (uint32_t) used_first, (uint32_t) used_last);
+        used_first = used_last + pat_extend_run(p_alloc[0].PAT, used_last, total, PAT_FREE);
+    }
+#endif
+}
+
+alloc_result init_allocator_shared(uint32_t page_size_bytes, uint32_t page_number, int fd, const allocator_options* options, PFN_alloc_log log_function, allocator* out_alloc) {
+    allocator_options default_options = { BACKEND_SHARED, 0, ZEROING_EAGER, true, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    if(options == NULL) options = &default_options;
+    if(out_alloc == NULL) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Out-parameter for Allocator struct is NULL!");
+        return INVALID_PARAMETER;
+    }
+    if(page_size_bytes == 0 || page_size_bytes % 64 != 0) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Page size not a multiple of 64 bytes!");
+        return INVALID_PARAMETER;
+    }
+    if(page_number == 0 || page_number % 4 != 0) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Page number not a positive multiple of 4!");
+        return INVALID_PARAMETER;
+    }
+    if(options[0].placement != PLACEMENT_FIRST_FIT && options[0].placement != PLACEMENT_NEXT_FIT) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Shared allocators only place first or next fit!");
+        return INVALID_PARAMETER;
+    }
+    
+    struct shared_header layout;
+    memset(&layout, 0, sizeof(layout));
+    shared_layout(page_size_bytes, page_number, &layout);
+    /* truncating to 0 first drops whatever the file held, so all of it reads as zero like fresh pages */
+    if(ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t) layout.region_bytes) != 0) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Could not size the file of the shared allocator");
+        return INVALID_PARAMETER;
+    }
+    void* mapping = mmap(NULL, layout.region_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Could not map the file of the shared allocator");
+        return OUT_OF_MEMORY;
+    }
+    struct shared_header *header = mapping;
+    memcpy(header, &layout, sizeof(layout));
+    header->version = SHARED_VERSION;
+    header->zeroing = options[0].zeroing;
+    header->placement = options[0].placement;
+    read_boot_id(header->boot_id);
+    atomic_store(&(header->root), 0);
+    
+    alloc_result result = view_shared_allocator(header, log_function, out_alloc);
+    if(result == SUCCESS && !init_sync(out_alloc[0].sync, true)) result = ERROR_UNKNOWN;
+    if(result != SUCCESS) {
+        free(out_alloc[0].free_runs);
+        munmap(mapping, layout.region_bytes);
+        memset(out_alloc, 0, sizeof(allocator));
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Could not set up the shared allocator");
+        return result;
+    }
+    pat_set_range(out_alloc[0].PAT, page_number, PAT_bytes(page_number)*4, 0x03);
+    out_alloc[0].purge->watermark_pages = options[0].purge_watermark_pages;
+    out_alloc[0].purge->decay_ns = (uint64_t) options[0].purge_decay_ms * 1000000;
+    out_alloc[0].purge->goal = PURGE_IDLE;
+    build_free_run_index(out_alloc);
+    atomic_thread_fence(memory_order_release);
+    header->magic = SHARED_MAGIC;
+    start_trace(out_alloc);
+    
+    if(log_function != NULL) log_function(INITIALIZATION_SUCCESS, "Successfully initialized the shared allocator");
+    return SUCCESS;
+}
+
+alloc_result attach_allocator_shared(int fd, PFN_alloc_log log_function, allocator* out_alloc) {
+    if(out_alloc == NULL) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Out-parameter for Allocator struct is NULL!");
+        return INVALID_PARAMETER;
+    }
+    struct stat file_status;
+    if(fstat(fd, &file_status) != 0 || (size_t) file_status.st_size < sizeof(struct shared_header)) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "The file doesn't hold a shared allocator!");
+        return INVALID_PARAMETER;
+    }
+    struct shared_header *header = mmap(NULL, sizeof(struct shared_header), PROT_READ, MAP_SHARED, fd, 0);
+    if(header == MAP_FAILED) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Could not map the file of the shared allocator");
+        return OUT_OF_MEMORY;
+    }
+    /* the header must be exactly what this build would have written for its page size and number */
+    struct shared_header expected;
+    memset(&expected, 0, sizeof(expected));
+    bool valid = (header->magic == SHARED_MAGIC && header->version == SHARED_VERSION && header->header_bytes == sizeof(struct shared_header)
+        && header->page_size != 0 && header->page_size % 64 == 0 && header->allocated_pages != 0 && header->allocated_pages % 4 == 0
+        && (header->placement == PLACEMENT_FIRST_FIT || header->placement == PLACEMENT_NEXT_FIT)
+        && (header->zeroing == ZEROING_EAGER || header->zeroing == ZEROING_DISCARD));
+    if(valid) {
+        shared_layout(header->page_size, header->allocated_pages, &expected);
+        valid = (memcmp(&(expected.leaf_count), &(header->leaf_count), offsetof(struct shared_header, root) - offsetof(struct shared_header, leaf_count)) == 0
+            && expected.region_bytes <= (size_t) file_status.st_size);
+    }
+    munmap(header, sizeof(struct shared_header));
+    if(!valid) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "The file doesn't hold a shared allocator of this version!");
+        return INVALID_PARAMETER;
+    }
+    
+    header = mmap(NULL, expected.region_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(header == MAP_FAILED) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Could not map the file of the shared allocator");
+        return OUT_OF_MEMORY;
+    }
+    alloc_result result = view_shared_allocator(header, log_function, out_alloc);
+    if(result != SUCCESS) {
+        munmap(header, expected.region_bytes);
+        return result;
+    }
+    
+    char boot_id[BOOT_ID_BYTES];
+    read_boot_id(boot_id);
+    if(boot_id[0] != 0 && strncmp(boot_id, header->boot_id, BOOT_ID_BYTES) != 0) {
+        /* no process of an earlier boot can still hold the lock, so it is reset */
+        init_sync(out_alloc[0].sync, true);
+        recover_shared_state(out_alloc);
+        memcpy(header->boot_id, boot_id, BOOT_ID_BYTES);
+        if(log_function != NULL) log_function(NOTE, "The shared allocator outlived a reboot, its lock was reset");
+    }
+    start_trace(out_alloc);
+    
+    if(log_function != NULL) log_function(INITIALIZATION_SUCCESS, "Successfully attached to the shared allocator");
+    return SUCCESS;
+}
+
+alloc_offset offset_from_pointer(const allocator* p_alloc, const void* ptr) {
+    if(p_alloc == NULL || p_alloc[0].backend != BACKEND_SHARED) return 0;
+    const uint8_t *address = ptr;
+    if(address < p_alloc[0].data || address >= p_alloc[0].data + (size_t) p_alloc[0].allocated_pages*p_alloc[0].page_size) return 0;
+    return (alloc_offset) (address - (const uint8_t*) p_alloc[0].shared);
+}
+
+void* pointer_from_offset(const allocator* p_alloc, alloc_offset offset) {
+    if(p_alloc == NULL || p_alloc[0].backend != BACKEND_SHARED) return NULL;
+    uint64_t data_offset = p_alloc[0].shared->data_offset;
+    if(offset < data_offset || offset >= data_offset + (uint64_t) p_alloc[0].allocated_pages*p_alloc[0].page_size) return NULL;
+    return (uint8_t*) p_alloc[0].shared + offset;
+}
+
+alloc_result set_shared_root(const allocator* p_alloc, alloc_offset root) {
+    if(p_alloc == NULL || p_alloc[0].backend != BACKEND_SHARED) {
+        return INVALID_PARAMETER;
+    }
+    atomic_store(&(p_alloc[0].shared->root), root);
+    return SUCCESS;
+}
+
+alloc_offset get_shared_root(const allocator* p_alloc) {
+    if(p_alloc == NULL || p_alloc[0].backend != BACKEND_SHARED) return 0;
+    return atomic_load(&(p_alloc[0].shared->root));
+}
+#else
+alloc_result init_allocator_shared(uint32_t page_size_bytes, uint32_t page_number, int fd, const allocator_options* options, PFN_alloc_log log_function, allocator* out_alloc) {
+    (void) page_size_bytes; (void) page_number; (void) fd; (void) options; (void) out_alloc;
+    if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Shared allocators are not available on this platform!");
+    return INVALID_PARAMETER;
+}
+
+alloc_result attach_allocator_shared(int fd, PFN_alloc_log log_function, allocator* out_alloc) {
+    (void) fd; (void) out_alloc;
+    if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Shared allocators are not available on this platform!");
+    return INVALID_PARAMETER;
+}
+
+alloc_offset offset_from_pointer(const allocator* p_alloc, const void* ptr) { (void) p_alloc; (void) ptr; return 0; }
+void* pointer_from_offset(const allocator* p_alloc, alloc_offset offset) { (void) p_alloc; (void) offset; return NULL; }
+alloc_result set_shared_root(const allocator* p_alloc, alloc_offset root) { (void) p_alloc; (void) root; return INVALID_PARAMETER; }
+alloc_offset get_shared_root(const allocator* p_alloc) { (void) p_alloc; return 0; }
+#endif
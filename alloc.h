@@ -1,4 +1,8 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum alloc_code {
@@ -13,7 +17,7 @@ typedef enum alloc_code {
     REALLOCATION_SUCCESS,
     REALLOCATION_ERROR,
     DEALLOCATION_SUCCESS,
-    DEALLOCATION_ERROR.
+    DEALLOCATION_ERROR,
     SIZE_SUCCESS,
     SIZE_ERROR,
     NOTE,
@@ -31,6 +35,141 @@ typedef enum alloc_result {
 
 typedef void (*PFN_alloc_log)(alloc_code code, char* msg);
 
+typedef enum allocator_backend {
+    BACKEND_CALLOC,  /* data is calloc'd and realloc'd on expansion, which may move it */
+    BACKEND_MMAP,    /* data is reserved once with mmap(PROT_NONE) and committed with mprotect, it never moves */
+    BACKEND_SHARED   /* made by init_allocator_shared or attach_allocator_shared only: data, PAT, index and lock live in a
+                        MAP_SHARED mapping of a file descriptor that other processes can attach to, with a fixed page number */
+} allocator_backend;
+
+typedef enum allocator_zeroing {
+    ZEROING_EAGER,   /* 01 pages are memset when a zeroed allocation or growth claims them */
+    ZEROING_DISCARD  /* BACKEND_MMAP only: freed pages are handed back with madvise(MADV_DONTNEED), which zeroes them, and marked 00
+                        (BACKEND_SHARED: with MADV_REMOVE, which frees the backing of the file) */
+} allocator_zeroing;
+
+typedef enum allocator_placement {
+    PLACEMENT_FIRST_FIT,      /* lowest-addressed free run that fits */
+    PLACEMENT_NEXT_FIT,       /* first fit from where the last allocation ended, wrapping around */
+    PLACEMENT_BEST_FIT,       /* smallest free run that fits, the lowest-addressed one among equals */
+    PLACEMENT_SEGREGATED_FIT  /* free runs kept in classes by length (powers of two), first fit in the request's class, else the lowest run of the next nonempty class */
+} allocator_placement;
+
+typedef enum allocator_huge_pages {
+    HUGE_PAGES_NONE,         /* regular pages of the operating system */
+    HUGE_PAGES_TRANSPARENT,  /* BACKEND_MMAP only: the data is aligned to huge pages and marked with madvise(MADV_HUGEPAGE) */
+    HUGE_PAGES_HUGETLB       /* BACKEND_MMAP only: the data is committed with MAP_HUGETLB from the huge page pool, else as TRANSPARENT */
+} allocator_huge_pages;
+
+typedef struct allocator_options {
+    allocator_backend backend;
+        /* BACKEND_MMAP only: pages of address space reserved up front, which is the limit for expand_alloctor;
+            0 reserves ALLOC_DEFAULT_RESERVE_BYTES */
+    uint32_t reserved_pages;
+    allocator_zeroing zeroing;
+        /* allow the allocation functions to be called from several threads at once: searches and PAT updates
+            are serialized by an internal lock, while small freed runs are kept in per-thread caches that serve
+            the next allocation of the same page count without touching the shared state (frees still take the
+            lock to validate, and reject runs already parked in a cache);
+            expand_alloctor and deinit_allocator still must not overlap with any other call */
+    bool concurrent;
+        /* BACKEND_MMAP only: place the data in this range, which the caller already reserved with
+            mmap(PROT_NONE) for at least reserved_pages pages; deinit_allocator then returns it to the
+            reserved state instead of unmapping it. NULL makes the allocator reserve its own range */
+    void* reserved_address;
+        /* where unaligned allocations are placed; aligned ones and batches always go first fit */
+    allocator_placement placement;
+        /* backing of the data with huge pages; falls back to the next weaker kind when they are unavailable,
+            the kind actually used is left in allocator::huge_pages */
+    allocator_huge_pages huge_pages;
+        /* BACKEND_MMAP only: freed pages that stay unused are returned to the kernel in the background of the
+            allocation functions (see purge_freed_pages) once there are more than purge_watermark_pages of them,
+            down to half as many, or once the oldest of them has been free for purge_decay_ms; 0 disables either */
+    uint32_t purge_watermark_pages;
+    uint32_t purge_decay_ms;
+} allocator_options;
+
+#define ALLOC_DEFAULT_RESERVE_BYTES ((size_t) 64 << 30)
+#define ALLOC_PURGE_MIN_RUN_BYTES ((size_t) 64 << 10)
+/* BACKEND_MMAP on Linux: growth that can't happen in place moves allocations of at least this many bytes by
+   remapping their pages (mremap) instead of copying them */
+#define ALLOC_REMAP_MIN_BYTES ((size_t) 2 << 20)
+
+typedef struct allocator_stats {
+    /* how zeroed allocations (and zeroed growth in place) got their memory zeroed */
+    uint64_t zeroed_allocations_clean;   /* all pages were 00 already: fresh, discarded on free or prezeroed */
+    uint64_t zeroed_allocations_memset;  /* some 01 pages had to be memset on the allocation path */
+    uint64_t pages_memset;               /* 01 pages memset on the allocation path */
+    uint64_t pages_discarded;            /* freed pages given back with madvise under ZEROING_DISCARD and marked 00 */
+    uint64_t pages_prezeroed;            /* 01 pages turned into 00 ahead of demand by prezero_freed_pages */
+    uint64_t pages_purged;               /* 01 pages returned to the kernel and marked 00 by purging */
+    /* allocations made (including the new places of resizes that moved) and their sizes as asked for and as
+       rounded up to whole pages, which shows the waste inside pages */
+    uint64_t allocations_made;
+    uint64_t bytes_requested;
+    uint64_t bytes_rounded;
+    /* the pages of the PAT right now, by state; runs held in thread caches count as allocated */
+    uint64_t pages_free_zeroed;          /* 00 */
+    uint64_t pages_free_dirty;           /* 01 */
+    uint64_t live_allocations;           /* 10 */
+    uint64_t pages_continuation;         /* 11 */
+    uint64_t used_pages;                 /* 10 and 11 */
+    uint64_t peak_used_pages;            /* the most pages that were ever 10 or 11 at once */
+    /* how resizes that couldn't grow over the free pages after the allocation moved its data */
+    uint64_t resize_bytes_copied;        /* with memmove or memcpy */
+    uint64_t resize_bytes_remapped;      /* by moving whole OS pages with mremap (see ALLOC_REMAP_MIN_BYTES) */
+} allocator_stats;
+
+/* the free space of an allocator, from a pass over the PAT */
+#define ALLOC_HEAP_MAP_CLASSES 32
+typedef struct allocator_heap_map {
+    uint64_t free_runs[ALLOC_HEAP_MAP_CLASSES];  /* maximal runs of free (00 or 01) pages with a length in [2^k, 2^(k+1)) */
+    uint64_t free_run_count;
+    uint64_t free_pages;
+    uint32_t largest_free_run;
+} allocator_heap_map;
+
+/* Binary tracing: built with ALLOC_TRACE defined (for every file including alloc.h), each call of the allocation
+   functions leaves a fixed-size record in a ring of ALLOC_TRACE_RECORDS records per allocator, which the oldest
+   records are overwritten in when it is full. Writers claim slots with an atomic counter and never wait on each
+   other or on readers. Without ALLOC_TRACE none of this is compiled in. tools/alloc_trace_decode.c turns a dump
+   into a replayable trace and latency histograms */
+#ifndef ALLOC_TRACE_RECORDS
+#define ALLOC_TRACE_RECORDS (1 << 16)  /* a power of two */
+#endif
+
+typedef enum alloc_trace_op {
+    TRACE_ALLOC,     /* alloc_align_offset_zeroable and each allocation of alloc_batch */
+    TRACE_RESIZE,    /* resize_oldsize_zeroable and resize_oldsize_zeroable_copy */
+    TRACE_FREE,      /* free_size and each pointer of free_batch */
+    TRACE_RELOCATE   /* relocate_lower */
+} alloc_trace_op;
+
+typedef struct alloc_trace_record {
+    uint64_t timestamp_ns;   /* CLOCK_MONOTONIC at the start of the call */
+    uint64_t duration_ns;
+    uint64_t size;           /* bytes asked for, the new size for resizes, 0 for frees and relocations */
+    uint32_t page;           /* first page of the allocation after the call, UINT32_MAX for none (frees, failures) */
+    uint32_t pages;
+    uint32_t old_page;       /* first page of the allocation the call was given, UINT32_MAX for none (allocations) */
+    uint32_t old_pages;
+    uint32_t pages_scanned;  /* PAT pages the search read word by word, after the free-run index narrowed it down */
+    uint8_t op;              /* alloc_trace_op */
+    uint8_t result;          /* alloc_result */
+    uint8_t alignment_bits;
+    uint8_t zeroed;
+} alloc_trace_record;
+
+/* a dump is this header followed by record_count records */
+#define ALLOC_TRACE_MAGIC "PALTRC01"
+typedef struct alloc_trace_header {
+    char magic[8];
+    uint32_t record_bytes;   /* sizeof(alloc_trace_record) */
+    uint32_t page_size;
+    uint64_t record_count;
+    uint64_t lost_records;   /* overwritten before the dump, or torn by a concurrent writer */
+} alloc_trace_header;
+
 typedef struct allocator {
     uint32_t page_size;
     uint32_t allocated_pages;
@@ -42,26 +181,109 @@ typedef struct allocator {
             stored as _little endian_, so for pages A B C D as bit pattern DDCCBBAA
         */
     uint8_t *PAT;  
+        /* page count of the allocation starting at each 10 page of the PAT (undefined for the other pages),
+            so sizes are looked up in O(1) instead of counting the 11 continuations */
+    uint32_t *run_pages;
     uint8_t *data;
+        /* Free-run index over the PAT: a segment tree over blocks of 32 pages that stores
+            the free prefix, free suffix and longest free run of every node, so a run of
+            N free pages is found in O(log pages) instead of a walk over the whole PAT
+        */
+    struct free_run_index *free_runs;
     PFN_alloc_log log_function;
+    allocator_backend backend;
+    uint32_t reserved_pages;
+    bool external_reservation;
+    allocator_zeroing zeroing;
+    allocator_placement placement;
+        /* the huge page backing in use: the requested one or what it fell back to, HUGE_PAGES_NONE if none was requested */
+    allocator_huge_pages huge_pages;
+    size_t huge_page_bytes;  /* 0 without huge pages */
+    size_t commit_bytes;     /* BACKEND_MMAP only: granularity of committing and discarding data, a huge page under HUGE_PAGES_HUGETLB */
+    allocator_stats *stats;
+    struct allocator_purge *purge;  /* count of the 01 pages, and the state of purging them */
+    struct allocator_sync *sync;  /* NULL unless created with the concurrent option */
+    struct shared_header *shared; /* BACKEND_SHARED only: the start of the mapping */
+#ifdef ALLOC_TRACE
+    struct alloc_trace *trace;    /* the ring of trace records, per process for shared allocators; NULL if it couldn't be made */
+#endif
 } allocator;
 
 /* to be used for the old_size parameters in case of no data */
 #define NO_OLD_SIZE_DATA ((size_t) (-1L))
 
+/* position of an allocation of a shared allocator relative to the start of its mapping, which stays valid in
+   every process and across restarts, unlike the pointer; 0 is no allocation */
+typedef uint64_t alloc_offset;
+
 
 
 alloc_result init_allocator(uint32_t page_size_bytes, uint32_t initial_page_number, PFN_alloc_log log_function, allocator* out_alloc);
+alloc_result init_allocator_options(uint32_t page_size_bytes, uint32_t initial_page_number, const allocator_options* options, PFN_alloc_log log_function, allocator* out_alloc);
 alloc_result expand_alloctor(allocator* p_alloc, uint32_t new_page_number);
 alloc_result deinit_allocator(allocator* p_alloc);
 
+/* Shared allocators: the header, PAT, run length table, free-run index, stats and a process-shared (robust) lock are
+   placed at the start of a MAP_SHARED mapping of fd, followed by the data, so several processes can allocate from one
+   heap, and with a file its contents survive restarts. fd can come from memfd_create, shm_open or open; it is sized to
+   fit page_number pages, which can't be expanded later. Shared allocators are always concurrent, without thread
+   caches (every call takes the lock); the concurrent, backend, reserved and huge page options are ignored and the
+   placement must be first or next fit. Alignments above the OS page size only hold in the mapping that made the
+   allocation, as the others are placed elsewhere */
+alloc_result init_allocator_shared(uint32_t page_size_bytes, uint32_t page_number, int fd, const allocator_options* options, PFN_alloc_log log_function, allocator* out_alloc);
+/* maps the shared allocator in fd without copying anything, after checking its header; the first attach after a
+   reboot (of a file that outlived it) resets the lock and must not race with others */
+alloc_result attach_allocator_shared(int fd, PFN_alloc_log log_function, allocator* out_alloc);
+/* deinit_allocator only unmaps a shared allocator, its contents stay in fd */
+
+/* BACKEND_SHARED only: converts between pointers into this mapping and offsets, NULL and 0 for anything outside */
+alloc_offset offset_from_pointer(const allocator* p_alloc, const void* ptr);
+void* pointer_from_offset(const allocator* p_alloc, alloc_offset offset);
+/* BACKEND_SHARED only: an offset kept in the header, for finding the data again after attaching */
+alloc_result set_shared_root(const allocator* p_alloc, alloc_offset root);
+alloc_offset get_shared_root(const allocator* p_alloc);
 
-alloc_result get_size(const allocator* p_alloc, void* ptr, size_t** size);
+
+alloc_result get_size(const allocator* p_alloc, void* ptr, size_t* size);
 alloc_result alloc_align_offset_zeroable(const allocator* p_alloc, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr);
 alloc_result resize_oldsize_zeroable(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool allow_new_alignment, bool zero_new_pages, void** new_ptr);
 alloc_result resize_oldsize_zeroable_copy(const allocator* p_alloc, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr);
 alloc_result free_size(const allocator* p_alloc, void* ptr, size_t old_size);
 
+/* count allocations of size bytes each, found in a single pass over the PAT and then marked in bulk;
+   all or nothing, on failure none of them is made */
+alloc_result alloc_batch(const allocator* p_alloc, size_t size, uint32_t count, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptrs);
+/* frees count allocations, releasing adjacent ones as one range; stops at the first invalid pointer,
+   with the ones before it freed */
+alloc_result free_batch(const allocator* p_alloc, void** ptrs, uint32_t count);
+/* moves the allocation at old_ptr to the lowest free run that holds it, or else slides it down over the free pages
+   right below it (memmove), and leaves it in place if neither exists; for compacting, the caller must own every
+   reference to it (see handles.h) */
+alloc_result relocate_lower(const allocator* p_alloc, void* old_ptr, void** new_ptr);
+
+/* zeroes up to max_pages freed 01 pages and marks them 00, so later zeroed allocations don't have to;
+   meant for idle time, and unless the allocator is concurrent not to be called alongside the other functions */
+alloc_result prezero_freed_pages(const allocator* p_alloc, uint32_t max_pages, uint32_t* out_zeroed_pages);
+/* BACKEND_MMAP only: returns up to max_pages freed 01 pages to the kernel with madvise(MADV_DONTNEED) and marks them
+   00, walking the free runs from where the last purge stopped; runs shorter than ALLOC_PURGE_MIN_RUN_BYTES are kept,
+   as they are likely reused soon. Unless the allocator is concurrent not to be called alongside the other functions */
+alloc_result purge_freed_pages(const allocator* p_alloc, uint32_t max_pages, uint32_t* out_purged_pages);
+/* the counters are kept on the fly; built with ALLOC_NO_STATS, the counters of allocations, bytes asked for and
+   moved by resizes, and pages by state are compiled out and read 0 */
+alloc_result get_allocator_stats(const allocator* p_alloc, allocator_stats* out_stats);
+/* walks the PAT word by word, under the lock for concurrent allocators */
+alloc_result get_heap_map(const allocator* p_alloc, allocator_heap_map* out_map);
+/* concurrent, non-shared allocators only: hands the runs in all per-thread caches back to the shared pages */
+alloc_result flush_thread_caches(const allocator* p_alloc);
+
+#ifdef ALLOC_TRACE
+/* copies up to max_records records, from the one numbered cursor[0] on, into records and advances the cursor past
+   them; records that were overwritten in the meantime are skipped and counted in out_lost (if not NULL) */
+alloc_result read_allocator_trace(const allocator* p_alloc, uint64_t* cursor, alloc_trace_record* records, uint32_t max_records, uint32_t* out_count, uint64_t* out_lost);
+/* writes the records still in the ring to the file at path, see alloc_trace_header */
+alloc_result dump_allocator_trace(const allocator* p_alloc, const char* path);
+#endif
+
 
 /* usable like:
 
@@ -76,3 +298,5 @@ static void* malloc(size_t size) {
 etc.
 
 */
+
+#endif
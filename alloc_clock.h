@@ -0,0 +1,17 @@
+#ifndef ALLOC_CLOCK_H
+#define ALLOC_CLOCK_H
+
+/* The monotonic clock behind the purge decay, the trace timestamps and the compaction budget, shared by alloc.c and
+   handles.c. clock_gettime is POSIX, so the including file defines _DEFAULT_SOURCE or _GNU_SOURCE first when
+   compiling with a strict -std=. */
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,237 @@
+/* for MAP_ANONYMOUS and friends when compiling with a strict -std= */
+#define _DEFAULT_SOURCE
+
+#include "alloc_set.h"
+
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ALLOC_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+
+static bool is_power_of_two(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static int log2_floor(size_t value) {
+    int bits = 0;
+    while(value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+/* the smallest class in which size needs at most ALLOC_SET_MAX_PAGES pages, or the largest class */
+static uint32_t class_for_size(const allocator_set* p_set, size_t size) {
+    uint32_t k = 0;
+    while(k + 1 < p_set->class_count && size > ((size_t) ALLOC_SET_MAX_PAGES << (p_set->min_page_bits + k))) k++;
+    return k;
+}
+
+/* grows a class so that it has room for at least needed_pages more pages, doubling it if that is more */
+static bool grow_class(allocator_set* p_set, uint32_t k, size_t needed_pages) {
+    allocator *p_alloc = &(p_set->classes[k]);
+    if(!p_set->grows || p_alloc->allocated_pages >= p_alloc->reserved_pages) return false;
+    size_t target = (size_t) p_alloc->allocated_pages * 2;
+    if(target < p_alloc->allocated_pages + needed_pages) target = p_alloc->allocated_pages + needed_pages;
+    if(target < 4) target = 4;
+    target = ((target + 3) / 4) * 4;
+    if(target > p_alloc->reserved_pages) target = p_alloc->reserved_pages;
+    return expand_alloctor(p_alloc, (uint32_t) target) == SUCCESS;
+}
+
+static alloc_result alloc_in_class(allocator_set* p_set, uint32_t k, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
+    allocator *p_alloc = &(p_set->classes[k]);
+    alloc_result result = alloc_align_offset_zeroable(p_alloc, size, alignment_bits, offset_to_alignment, zeroed, out_ptr);
+    while(result == OUT_OF_MEMORY && grow_class(p_set, k, size / p_alloc->page_size + 1)) {
+        result = alloc_align_offset_zeroable(p_alloc, size, alignment_bits, offset_to_alignment, zeroed, out_ptr);
+    }
+    return result;
+}
+
+
+alloc_result init_allocator_set(uint32_t min_page_size, uint32_t max_page_size, size_t initial_bytes_per_class, size_t reserved_bytes_per_class, const allocator_options* options, PFN_alloc_log log_function, allocator_set* out_set) {
+    if(out_set == NULL) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Out-parameter for Allocator set struct is NULL!");
+        return INVALID_PARAMETER;
+    }
+#ifndef ALLOC_HAVE_MMAP
+    if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Allocator sets need the mmap backend, which is not available on this platform!");
+    return INVALID_PARAMETER;
+#else
+    if(min_page_size < 64 || !is_power_of_two(min_page_size) || !is_power_of_two(max_page_size) || max_page_size < min_page_size) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Page sizes of an allocator set must be powers of two of at least 64 bytes!");
+        return INVALID_PARAMETER;
+    }
+    uint32_t class_count = log2_floor(max_page_size) - log2_floor(min_page_size) + 1;
+    if(class_count > ALLOC_SET_MAX_CLASSES) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Too many size classes for an allocator set!");
+        return INVALID_PARAMETER;
+    }
+    /* every slice spans whole OS pages (up to 64 KiB ones), holds at least 4 pages of the largest class
+       and at most 2**32 - 4 pages of the smallest one */
+    int slice_bits = log2_floor(reserved_bytes_per_class);
+    if(((size_t) 1 << slice_bits) < reserved_bytes_per_class) slice_bits++;
+    if(slice_bits < 16) slice_bits = 16;
+    if(slice_bits < log2_floor(max_page_size) + 2) slice_bits = log2_floor(max_page_size) + 2;
+    if(slice_bits - log2_floor(min_page_size) >= 32) slice_bits = log2_floor(min_page_size) + 31;
+
+    memset(out_set, 0, sizeof(allocator_set));
+    out_set->class_count = class_count;
+    out_set->min_page_bits = log2_floor(min_page_size);
+    out_set->slice_bits = slice_bits;
+    out_set->log_function = log_function;
+    out_set->grows = (options == NULL || !options->concurrent);
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    void* reservation = mmap(NULL, (size_t) class_count << slice_bits, PROT_NONE, flags, -1, 0);
+    if(reservation == MAP_FAILED) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Could not reserve the address range for the allocator set");
+        return OUT_OF_MEMORY;
+    }
+    out_set->base = reservation;
+
+    for(uint32_t k = 0; k < class_count; k++) {
+        uint32_t page_size = min_page_size << k;
+        allocator_options class_options = { BACKEND_MMAP, 0, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+        if(options != NULL) class_options = options[0];
+        class_options.backend = BACKEND_MMAP;
+        class_options.reserved_pages = (uint32_t) (((size_t) 1 << slice_bits) / page_size);
+        class_options.reserved_address = &(out_set->base[(size_t) k << slice_bits]);
+        size_t initial_pages = out_set->grows ? ((initial_bytes_per_class / page_size + 3) / 4) * 4 : class_options.reserved_pages;
+        if(initial_pages < 4) initial_pages = 4;
+        if(initial_pages > class_options.reserved_pages) initial_pages = class_options.reserved_pages;
+
+        alloc_result class_result = init_allocator_options(page_size, (uint32_t) initial_pages, &class_options, log_function, &(out_set->classes[k]));
+        if(class_result != SUCCESS) {
+            for(uint32_t j = 0; j < k; j++) deinit_allocator(&(out_set->classes[j]));
+            munmap(out_set->base, (size_t) class_count << slice_bits);
+            memset(out_set, 0, sizeof(allocator_set));
+            return class_result;
+        }
+    }
+
+    if(log_function != NULL) log_function(INITIALIZATION_SUCCESS, "Successfully initialized the allocator set");
+    return SUCCESS;
+#endif
+}
+
+alloc_result deinit_allocator_set(allocator_set* p_set) {
+    if(p_set == NULL) {
+        return INVALID_PARAMETER;
+    }
+    PFN_alloc_log log_function = p_set->log_function;
+
+    alloc_result result = SUCCESS;
+    for(uint32_t k = 0; k < p_set->class_count; k++) {
+        if(deinit_allocator(&(p_set->classes[k])) != SUCCESS) result = ERROR_UNKNOWN;
+    }
+#ifdef ALLOC_HAVE_MMAP
+    if(p_set->base != NULL) munmap(p_set->base, (size_t) p_set->class_count << p_set->slice_bits);
+#endif
+    memset(p_set, 0, sizeof(allocator_set));
+
+    if(log_function != NULL) log_function(result == SUCCESS ? DEINITIALIZATION_SUCCESS : DEINITIALIZATION_ERROR, "Deinitialized the allocator set");
+    return result;
+}
+
+allocator* set_owner(const allocator_set* p_set, const void* ptr) {
+    if(p_set == NULL || (const uint8_t*) ptr < p_set->base) return NULL;
+    size_t k = ((size_t) ((const uint8_t*) ptr - p_set->base)) >> p_set->slice_bits;
+    if(k >= p_set->class_count) return NULL;
+    return (allocator*) &(p_set->classes[k]);
+}
+
+alloc_result set_get_size(const allocator_set* p_set, void* ptr, size_t* size) {
+    if(p_set == NULL) {
+        return INVALID_PARAMETER;
+    }
+    allocator *owner = set_owner(p_set, ptr);
+    if(owner == NULL) {
+        if(p_set->log_function != NULL) p_set->log_function(SIZE_ERROR, "Pointer outside of the allocator set!");
+        return INVALID_ADDRESS;
+    }
+    return get_size(owner, ptr, size);
+}
+
+alloc_result set_alloc_align_offset_zeroable(allocator_set* p_set, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
+    if(p_set == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(size == 0 || out_ptr == NULL) {
+        if(p_set->log_function != NULL) p_set->log_function(ALLOCATION_ERROR, "Attempt to allocate 0 bytes or without out-pointer!");
+        return INVALID_PARAMETER;
+    }
+
+    /* if the fitting class is exhausted, the larger ones still can serve the request */
+    alloc_result result = OUT_OF_MEMORY;
+    for(uint32_t k = class_for_size(p_set, size); k < p_set->class_count && result == OUT_OF_MEMORY; k++) {
+        result = alloc_in_class(p_set, k, size, alignment_bits, offset_to_alignment, zeroed, out_ptr);
+    }
+    return result;
+}
+
+alloc_result set_resize_oldsize_zeroable(allocator_set* p_set, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr) {
+    if(p_set == NULL) {
+        return INVALID_PARAMETER;
+    }
+    allocator *owner = set_owner(p_set, old_ptr);
+    if(owner == NULL) {
+        if(p_set->log_function != NULL) p_set->log_function(REALLOCATION_ERROR, "Pointer to be resized outside of the allocator set!");
+        return INVALID_ADDRESS;
+    }
+    uint32_t old_class = owner - p_set->classes;
+    uint32_t new_class = (new_size == 0) ? old_class : class_for_size(p_set, new_size);
+
+    /* the owner can be larger than the fitting class when that one was exhausted at allocation, so the allocation
+       only migrates if it outgrows the owner or shrinks to two classes or more below it */
+    bool migrate = new_class > old_class;
+    if(new_class + 1 < old_class) {
+        size_t old_bytes;
+        migrate = get_size(owner, old_ptr, &old_bytes) == SUCCESS && new_size < old_bytes;
+    }
+    if(!migrate) {
+        alloc_result result = resize_oldsize_zeroable(owner, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, true, zero_new_pages, new_ptr);
+        while(result == OUT_OF_MEMORY && grow_class(p_set, old_class, new_size / owner->page_size + 1)) {
+            result = resize_oldsize_zeroable(owner, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, true, zero_new_pages, new_ptr);
+        }
+        return result;
+    }
+
+    /* the new size doesn't belong in the owner, so the allocation migrates to the fitting class */
+    size_t old_bytes;
+    alloc_result size_result = get_size(owner, old_ptr, &old_bytes);
+    if(size_result != SUCCESS) return size_result;
+    if(old_size != 0 && old_size != NO_OLD_SIZE_DATA && (old_size + owner->page_size - 1) / owner->page_size != old_bytes / owner->page_size) {
+        if(p_set->log_function != NULL) p_set->log_function(REALLOCATION_ERROR, "Pointer to be resized doesn't have the expected length!");
+        return INVALID_ADDRESS;
+    }
+    void* moved_ptr;
+    alloc_result alloc_result_new = set_alloc_align_offset_zeroable(p_set, new_size, alignment_bits, offset_to_alignment, zero_new_pages, &moved_ptr);
+    if(alloc_result_new != SUCCESS) return alloc_result_new;
+    memcpy(moved_ptr, old_ptr, (old_bytes < new_size) ? old_bytes : new_size);
+    alloc_result free_result = free_size(owner, old_ptr, old_size);
+    if(free_result != SUCCESS) return free_result;
+
+    new_ptr[0] = moved_ptr;
+    if(p_set->log_function != NULL) p_set->log_function(REALLOCATION_SUCCESS, "Allocation migrated to another size class");
+    return SUCCESS;
+}
+
+alloc_result set_free_size(allocator_set* p_set, void* ptr, size_t old_size) {
+    if(p_set == NULL) {
+        return INVALID_PARAMETER;
+    }
+    allocator *owner = set_owner(p_set, ptr);
+    if(owner == NULL) {
+        if(p_set->log_function != NULL) p_set->log_function(DEALLOCATION_ERROR, "Pointer to be freed outside of the allocator set!");
+        return INVALID_ADDRESS;
+    }
+    return free_size(owner, ptr, old_size);
+}
@@ -0,0 +1,47 @@
+#ifndef ALLOC_SET_H
+#define ALLOC_SET_H
+
+#include "alloc.h"
+
+/* A set of allocators with geometrically growing page sizes, e.g. 64 bytes up to 1 MiB, that routes
+   every request to the allocator whose page size fits it: a request goes to the smallest page size
+   for which it needs at most ALLOC_SET_MAX_PAGES pages, which bounds the rounding waste to a page
+   of that class.
+
+   All classes live in one address range reserved up front, each in a slice of the same power of two
+   size, so the owning class of a pointer follows from its address with a subtraction and a shift.
+   The classes use the mmap backend and grow by doubling within their slice when they run out of
+   pages (concurrent sets are created with their slices fully committed instead, since expansion
+   can't overlap with other calls).
+*/
+
+#define ALLOC_SET_MAX_CLASSES 32
+#define ALLOC_SET_MAX_PAGES 8
+
+typedef struct allocator_set {
+    uint32_t class_count;
+    int min_page_bits;      /* log2 of the page size of class 0, class k has pages of 2**(min_page_bits+k) bytes */
+    int slice_bits;         /* log2 of the bytes reserved for every class */
+    uint8_t *base;          /* start of the reservation, class k starts at base + (k << slice_bits) */
+    bool grows;
+    allocator classes[ALLOC_SET_MAX_CLASSES];
+    PFN_alloc_log log_function;
+} allocator_set;
+
+
+/* page sizes must be powers of two of at least 64 bytes; the options are passed on to every class,
+   with the backend forced to BACKEND_MMAP */
+alloc_result init_allocator_set(uint32_t min_page_size, uint32_t max_page_size, size_t initial_bytes_per_class, size_t reserved_bytes_per_class, const allocator_options* options, PFN_alloc_log log_function, allocator_set* out_set);
+alloc_result deinit_allocator_set(allocator_set* p_set);
+
+/* the class allocator a pointer belongs to, or NULL if it is outside the set */
+allocator* set_owner(const allocator_set* p_set, const void* ptr);
+
+alloc_result set_get_size(const allocator_set* p_set, void* ptr, size_t* size);
+alloc_result set_alloc_align_offset_zeroable(allocator_set* p_set, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr);
+/* resizes within the owning class if the new size still fits it, and migrates the allocation to the fitting class when it
+   outgrows the owner or shrinks to two classes or more below it */
+alloc_result set_resize_oldsize_zeroable(allocator_set* p_set, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr);
+alloc_result set_free_size(allocator_set* p_set, void* ptr, size_t old_size);
+
+#endif
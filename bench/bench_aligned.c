@@ -0,0 +1,115 @@
+/* Latency of 2 MiB-aligned allocations in a mostly full arena.
+
+   An allocator of 262144 pages of 4 KiB (1 GiB) is filled to about 90% with
+   allocations of 1 to 64 pages, of which random ones are freed again, so the
+   free space is scattered over many short runs; a few 2 MiB windows in the
+   upper half of the arena are cleared so that aligned requests can succeed,
+   but only after skipping most of the arena. Then 2 MiB allocations aligned
+   to 2 MiB (alignment_bits = 21) are made and freed again, timed against a
+   reference search that walks every free page and checks its address, the way
+   aligned requests were placed before they jumped between aligned candidates.
+
+   build: cc -O2 -I.. bench_aligned.c ../alloc.c -o bench_aligned -lpthread
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_NUMBER (1 << 18)
+#define ALIGNMENT_BITS 21
+#define ALIGNED_PAGES ((1 << ALIGNMENT_BITS) / PAGE_SIZE)
+#define FILL_RATIO 0.9
+#define CLEARED_WINDOWS 4
+#define ROUNDS 2000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static bool page_free(const allocator* p_alloc, uint32_t i) {
+    return ((p_alloc->PAT[i/4] >> (i%4)*2) & 0x2) == 0;
+}
+
+/* the first aligned start of ALIGNED_PAGES free pages, found page by page */
+static long reference_search(const allocator* p_alloc) {
+    uint32_t run = 0;
+    for(uint32_t i = 0; i < p_alloc->allocated_pages; i++) {
+        run = page_free(p_alloc, i) ? run + 1 : 0;
+        if(run >= ALIGNED_PAGES) {
+            uint32_t start = i + 1 - ALIGNED_PAGES;
+            if(((size_t) &(p_alloc->data[(size_t) start*PAGE_SIZE]) & ((1 << ALIGNMENT_BITS) - 1)) == 0) return start;
+        }
+    }
+    return -1;
+}
+
+int main(void) {
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return 1;
+    }
+
+    /* fill completely, then free random allocations until about 10% of the pages are free again */
+    static void* ptrs[PAGE_NUMBER];
+    static size_t sizes[PAGE_NUMBER];
+    uint32_t count = 0;
+    srand(42);
+    for(;;) {
+        size_t size = (size_t) (1 + rand() % 64) * PAGE_SIZE;
+        if(alloc_align_offset_zeroable(&alloc, size, 0, 0, false, &ptrs[count]) != SUCCESS) break;
+        sizes[count++] = size;
+    }
+    size_t free_pages = 0;
+    while(free_pages < (1.0 - FILL_RATIO) * PAGE_NUMBER) {
+        uint32_t k = rand() % count;
+        if(ptrs[k] == NULL) continue;
+        free_size(&alloc, ptrs[k], sizes[k]);
+        ptrs[k] = NULL;
+        free_pages += sizes[k] / PAGE_SIZE;
+    }
+    uint8_t *window_base = (uint8_t*) (((size_t) alloc.data + (1 << ALIGNMENT_BITS) - 1) & ~(size_t) ((1 << ALIGNMENT_BITS) - 1));
+    size_t window_count = (alloc.data + (size_t) PAGE_NUMBER*PAGE_SIZE - window_base) >> ALIGNMENT_BITS;
+    for(int w = 0; w < CLEARED_WINDOWS; w++) {
+        uint8_t *window = window_base + ((window_count/2 + rand() % (window_count/2 - 1)) << ALIGNMENT_BITS);
+        for(uint32_t k = 0; k < count; k++) {
+            if(ptrs[k] == NULL || (uint8_t*) ptrs[k] + sizes[k] <= window || (uint8_t*) ptrs[k] >= window + (1 << ALIGNMENT_BITS)) continue;
+            free_size(&alloc, ptrs[k], sizes[k]);
+            ptrs[k] = NULL;
+        }
+    }
+
+    double alloc_time = 0, reference_time = 0;
+    size_t failures = 0;
+    for(int round = 0; round < ROUNDS; round++) {
+        double start = now_ns();
+        long expected = reference_search(&alloc);
+        reference_time += now_ns() - start;
+
+        void* ptr;
+        start = now_ns();
+        alloc_result result = alloc_align_offset_zeroable(&alloc, (size_t) ALIGNED_PAGES*PAGE_SIZE, ALIGNMENT_BITS, 0, false, &ptr);
+        alloc_time += now_ns() - start;
+        if(result != SUCCESS) {
+            failures++;
+            if(expected >= 0) fprintf(stderr, "missed the aligned run at page %ld\n", expected);
+            continue;
+        }
+        if((uint8_t*) ptr != &(alloc.data[(size_t) expected*PAGE_SIZE])) fprintf(stderr, "placed differently from the reference\n");
+        free_size(&alloc, ptr, (size_t) ALIGNED_PAGES*PAGE_SIZE);
+    }
+
+    printf("search,ns_per_alloc,failed_allocations\n");
+    printf("candidate_stride,%.1f,%zu\n", alloc_time / ROUNDS, failures);
+    printf("page_walk_reference,%.1f,%zu\n", reference_time / ROUNDS, failures);
+
+    deinit_allocator(&alloc);
+    return 0;
+}
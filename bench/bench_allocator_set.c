@@ -0,0 +1,119 @@
+/* Throughput and internal fragmentation of an allocator set against single allocators.
+
+   Sizes are drawn log-uniformly between 16 bytes and 256 KiB. A pool of live
+   allocations is kept, and every step frees a random one and allocates a new
+   one in its place. Compared are an allocator set with page sizes from 64 bytes
+   to 64 KiB and single mmap allocators with 64 byte and 4 KiB pages. The
+   fragmentation is the ratio of rounded (get_size) to requested bytes over the
+   pool at the end of the run.
+
+   build: cc -O2 -I.. bench_allocator_set.c ../alloc.c ../alloc_set.c -o bench_allocator_set -lpthread -lm
+*/
+
+#include "alloc_set.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define POOL_SIZE 4096
+#define STEPS 200000
+#define RESERVED_BYTES ((size_t) 4 << 30)
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static size_t random_size(void) {
+    double exponent = log2(16.0) + (log2(256.0*1024) - log2(16.0)) * (rand() / (double) RAND_MAX);
+    return (size_t) exp2(exponent);
+}
+
+/* either a set or a single allocator, so both run through the same loop */
+typedef struct subject {
+    allocator_set* set;
+    allocator* single;
+} subject;
+
+static alloc_result subject_alloc(subject* s, size_t size, void** ptr) {
+    if(s->set != NULL) return set_alloc_align_offset_zeroable(s->set, size, 0, 0, false, ptr);
+    return alloc_align_offset_zeroable(s->single, size, 0, 0, false, ptr);
+}
+
+static alloc_result subject_free(subject* s, void* ptr, size_t size) {
+    if(s->set != NULL) return set_free_size(s->set, ptr, size);
+    return free_size(s->single, ptr, size);
+}
+
+static alloc_result subject_get_size(subject* s, void* ptr, size_t* size) {
+    if(s->set != NULL) return set_get_size(s->set, ptr, size);
+    return get_size(s->single, ptr, size);
+}
+
+static void run(const char* name, subject* s) {
+    static void* ptrs[POOL_SIZE];
+    static size_t sizes[POOL_SIZE];
+    srand(42);
+    for(int i = 0; i < POOL_SIZE; i++) {
+        sizes[i] = random_size();
+        if(subject_alloc(s, sizes[i], &ptrs[i]) != SUCCESS) {
+            fprintf(stderr, "%s: allocation failed\n", name);
+            return;
+        }
+    }
+
+    double start = now_ns();
+    for(int step = 0; step < STEPS; step++) {
+        int i = rand() % POOL_SIZE;
+        subject_free(s, ptrs[i], sizes[i]);
+        sizes[i] = random_size();
+        if(subject_alloc(s, sizes[i], &ptrs[i]) != SUCCESS) {
+            fprintf(stderr, "%s: allocation failed\n", name);
+            return;
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    double requested = 0, rounded = 0;
+    for(int i = 0; i < POOL_SIZE; i++) {
+        size_t actual;
+        subject_get_size(s, ptrs[i], &actual);
+        requested += sizes[i];
+        rounded += actual;
+        subject_free(s, ptrs[i], sizes[i]);
+    }
+    printf("%s,%.1f,%.3f\n", name, STEPS / (elapsed / 1e9) / 1e3, rounded / requested);
+}
+
+static void run_single(const char* name, uint32_t page_size) {
+    allocator_options options = { BACKEND_MMAP, (uint32_t) (RESERVED_BYTES / page_size) };
+    allocator alloc;
+    uint32_t pages = (uint32_t) (((size_t) POOL_SIZE * 512 * 1024 / page_size + 3) / 4 * 4);
+    if(init_allocator_options(page_size, pages, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "%s: could not initialize the allocator\n", name);
+        return;
+    }
+    subject s = { NULL, &alloc };
+    run(name, &s);
+    deinit_allocator(&alloc);
+}
+
+int main(void) {
+    printf("allocator,kops_per_s,rounded_per_requested\n");
+
+    static allocator_set set;
+    if(init_allocator_set(64, 64*1024, 1024*1024, RESERVED_BYTES, NULL, NULL, &set) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator set\n");
+        return 1;
+    }
+    subject s = { &set, NULL };
+    run("set_64B_to_64KiB", &s);
+    deinit_allocator_set(&set);
+
+    run_single("single_64B", 64);
+    run_single("single_4KiB", 4096);
+    return 0;
+}
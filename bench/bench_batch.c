@@ -0,0 +1,70 @@
+/* alloc_batch and free_batch against the same number of single calls.
+
+   With 64 byte pages, a heap is first filled to half with long-lived
+   allocations scattered over it, then rounds allocate and free BATCH_SIZE
+   buffers of 256 bytes, once through alloc_batch/free_batch and once through
+   alloc_align_offset_zeroable/free_size per buffer.
+
+   build: cc -O2 -I.. bench_batch.c ../alloc.c -o bench_batch -lpthread
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PAGE_SIZE 64
+#define PAGE_NUMBER (1 << 18)
+#define BUFFER_SIZE 256
+#define ROUNDS 2000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+/* fills the heap with allocations of 1-8 pages and frees every other one */
+static void fragment(allocator* p_alloc) {
+    static void* ptrs[PAGE_NUMBER / 8];
+    int count = 0;
+    srand(42);
+    while(count < PAGE_NUMBER / 8 && alloc_align_offset_zeroable(p_alloc, (size_t) (1 + rand() % 8)*PAGE_SIZE, 0, 0, false, &ptrs[count]) == SUCCESS) count++;
+    for(int i = 0; i < count; i += 2) free_size(p_alloc, ptrs[i], NO_OLD_SIZE_DATA);
+}
+
+static void run(uint32_t batch_size) {
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER };
+    allocator single_alloc, batch_alloc;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &single_alloc) != SUCCESS
+        || init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &batch_alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocators\n");
+        return;
+    }
+    fragment(&single_alloc);
+    fragment(&batch_alloc);
+
+    void* ptrs[1024];
+    double single_time = 0, batch_time = 0;
+    for(int round = 0; round < ROUNDS; round++) {
+        double start = now_ns();
+        for(uint32_t i = 0; i < batch_size; i++) alloc_align_offset_zeroable(&single_alloc, BUFFER_SIZE, 0, 0, true, &ptrs[i]);
+        for(uint32_t i = 0; i < batch_size; i++) free_size(&single_alloc, ptrs[i], BUFFER_SIZE);
+        single_time += now_ns() - start;
+
+        start = now_ns();
+        if(alloc_batch(&batch_alloc, BUFFER_SIZE, batch_size, 0, 0, true, ptrs) == SUCCESS) free_batch(&batch_alloc, ptrs, batch_size);
+        batch_time += now_ns() - start;
+    }
+    printf("%u,%.1f,%.1f\n", batch_size, single_time / ((double) ROUNDS*batch_size), batch_time / ((double) ROUNDS*batch_size));
+
+    deinit_allocator(&single_alloc);
+    deinit_allocator(&batch_alloc);
+}
+
+int main(void) {
+    printf("batch_size,ns_per_buffer_single,ns_per_buffer_batch\n");
+    for(uint32_t batch_size = 4; batch_size <= 1024; batch_size *= 4) run(batch_size);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/* Largest free run and compaction pauses under fragmentation.
+
+   For every time slice budget, the same fragmented heap is built: an
+   allocator of 65536 pages of 4 KiB (256 MiB) on the mmap backend is filled
+   through a handle table with allocations of 1 to 64 pages, random ones are
+   freed until half of the pages are free again, and 1% of the remaining
+   handles stay pinned. Then compact_handles is called with the budget until a
+   whole pass over the pages moves nothing. Reported are the largest free run
+   before and after, the slices it took, the MiB moved, and the median and
+   worst pause of a slice.
+
+   build: cc -O2 -I.. bench_compaction.c ../handles.c ../alloc.c -o bench_compaction -lpthread
+*/
+
+#include "handles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_NUMBER (1 << 16)
+#define MAX_SLICES 1000000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static bool page_free(const allocator* p_alloc, uint32_t i) {
+    return ((p_alloc->PAT[i/4] >> (i%4)*2) & 0x2) == 0;
+}
+
+static uint32_t largest_free_run(const allocator* p_alloc) {
+    uint32_t run = 0, largest = 0;
+    for(uint32_t i = 0; i < p_alloc->allocated_pages; i++) {
+        run = page_free(p_alloc, i) ? run + 1 : 0;
+        if(run > largest) largest = run;
+    }
+    return largest;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static void run(uint64_t budget_ns) {
+    static alloc_handle handles[PAGE_NUMBER];
+    static uint32_t pages[PAGE_NUMBER];
+    static double pauses[MAX_SLICES];
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    allocator alloc;
+    handle_table table;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS || init_handle_table(&alloc, NULL, &table) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return;
+    }
+
+    /* fill completely, then free random handles until half of the pages are free */
+    uint32_t count = 0;
+    srand(42);
+    for(;;) {
+        uint32_t n = 1 + rand() % 64;
+        if(handle_alloc(&table, (size_t) n*PAGE_SIZE, false, &handles[count]) != SUCCESS) break;
+        void* ptr;
+        handle_pin(&table, handles[count], &ptr);
+        memset(ptr, (int) count, (size_t) n*PAGE_SIZE);
+        handle_unpin(&table, handles[count]);
+        pages[count++] = n;
+    }
+    size_t free_pages = 0;
+    while(free_pages < PAGE_NUMBER / 2) {
+        uint32_t k = rand() % count;
+        if(handles[k] == 0) continue;
+        handle_free(&table, handles[k]);
+        handles[k] = 0;
+        free_pages += pages[k];
+    }
+    for(uint32_t k = 0; k < count; k++) {
+        void* ptr;
+        if(handles[k] != 0 && rand() % 100 == 0) handle_pin(&table, handles[k], &ptr);
+    }
+    uint32_t largest_before = largest_free_run(&alloc);
+
+    uint32_t slices = 0;
+    size_t moved_total = 0, moved_in_pass = 1;
+    while(moved_in_pass != 0 && slices < MAX_SLICES) {
+        bool pass_done = false;
+        moved_in_pass = 0;
+        while(!pass_done && slices < MAX_SLICES) {
+            size_t moved;
+            double start = now_ns();
+            compact_handles(&table, budget_ns, &moved, &pass_done);
+            pauses[slices++] = now_ns() - start;
+            moved_in_pass += moved;
+        }
+        moved_total += moved_in_pass;
+    }
+    uint32_t largest_after = largest_free_run(&alloc);
+
+    qsort(pauses, slices, sizeof(double), compare_doubles);
+    printf("%llu,%u,%u,%u,%.1f,%.1f,%.1f\n", (unsigned long long) budget_ns / 1000, largest_before, largest_after, slices,
+        (double) moved_total / (1 << 20), pauses[slices / 2] / 1e3, pauses[slices - 1] / 1e3);
+    deinit_handle_table(&table);
+    deinit_allocator(&alloc);
+}
+
+int main(void) {
+    printf("budget_us,largest_free_run_before,largest_free_run_after,slices,moved_mib,pause_p50_us,pause_max_us\n");
+    run(50000);
+    run(200000);
+    run(1000000);
+    run(10000000);
+    return 0;
+}
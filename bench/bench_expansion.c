@@ -0,0 +1,60 @@
+/* Startup and expansion cost of the calloc and the mmap backend.
+
+   Each backend starts with 16 MiB of pages, which are then touched so the
+   memory is really in use, and expands by doubling up to 4 GiB. The time of
+   init_allocator_options and of every expand_alloctor call is reported
+   together with whether the data array moved.
+
+   build: cc -O2 -I.. bench_expansion.c ../alloc.c -o bench_expansion
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define INITIAL_PAGES 4096
+#define FINAL_PAGES (1u << 20)
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static void run_backend(const char* name, allocator_backend backend) {
+    allocator_options options = { backend, FINAL_PAGES };
+    allocator alloc;
+
+    double start = now_ns();
+    if(init_allocator_options(PAGE_SIZE, INITIAL_PAGES, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "%s: could not initialize the allocator\n", name);
+        return;
+    }
+    printf("%s,init,%u,%.3f,0\n", name, INITIAL_PAGES, (now_ns() - start)/1e6);
+
+    for(uint32_t pages = INITIAL_PAGES; pages < FINAL_PAGES; pages *= 2) {
+        /* write to every page so expansion has resident memory to carry along */
+        void* ptr;
+        if(alloc_align_offset_zeroable(&alloc, (size_t) pages/2 * PAGE_SIZE, 0, 0, false, &ptr) == SUCCESS) {
+            memset(ptr, 0xA5, (size_t) pages/2 * PAGE_SIZE);
+        }
+        uint8_t *old_data = alloc.data;
+        start = now_ns();
+        if(expand_alloctor(&alloc, pages*2) != SUCCESS) {
+            fprintf(stderr, "%s: could not expand to %u pages\n", name, pages*2);
+            break;
+        }
+        printf("%s,expand,%u,%.3f,%d\n", name, pages*2, (now_ns() - start)/1e6, alloc.data != old_data);
+    }
+    deinit_allocator(&alloc);
+}
+
+int main(void) {
+    printf("backend,operation,pages,ms,data_moved\n");
+    run_backend("calloc", BACKEND_CALLOC);
+    run_backend("mmap", BACKEND_MMAP);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* Allocation latency against heap occupancy.
+
+   The heap is filled to a target level with allocations of 1-16 pages, every
+   other allocation is freed again to leave holes, then refilled to the target.
+   At each level, the time of an alloc/free pair is measured.
+
+   build: cc -O2 -I.. bench_fill_level.c ../alloc.c -o bench_fill_level
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PAGE_SIZE 256
+#define PAGE_NUMBER (1 << 20)
+#define MEASURED_PAIRS 20000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+int main(void) {
+    allocator alloc;
+    if(init_allocator(PAGE_SIZE, PAGE_NUMBER, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return 1;
+    }
+
+    void** ptrs = malloc(PAGE_NUMBER * sizeof(void*));
+    size_t count = 0;
+    size_t used_pages = 0;
+    srand(42);
+
+    printf("fill_percent,ns_per_alloc_free_pair\n");
+    for(int percent = 0; percent <= 95; percent += 5) {
+        size_t target = (size_t) PAGE_NUMBER * percent / 100;
+        while(used_pages < target) {
+            size_t pages = 1 + rand() % 16;
+            if(alloc_align_offset_zeroable(&alloc, pages*PAGE_SIZE, 0, 0, false, &ptrs[count]) != SUCCESS) break;
+            count++;
+            used_pages += pages;
+        }
+        /* punch holes so the free space is spread out instead of one run at the end */
+        for(size_t i = 0; i < count; i += 2) {
+            size_t bytes;
+            get_size(&alloc, ptrs[i], &bytes);
+            free_size(&alloc, ptrs[i], bytes);
+            used_pages -= bytes / PAGE_SIZE;
+            ptrs[i] = ptrs[--count];
+        }
+        while(used_pages < target) {
+            size_t pages = 1 + rand() % 16;
+            if(alloc_align_offset_zeroable(&alloc, pages*PAGE_SIZE, 0, 0, false, &ptrs[count]) != SUCCESS) break;
+            count++;
+            used_pages += pages;
+        }
+
+        double start = now_ns();
+        for(int i = 0; i < MEASURED_PAIRS; i++) {
+            void* ptr;
+            size_t pages = 1 + rand() % 16;
+            if(alloc_align_offset_zeroable(&alloc, pages*PAGE_SIZE, 0, 0, false, &ptr) == SUCCESS) {
+                free_size(&alloc, ptr, pages*PAGE_SIZE);
+            }
+        }
+        double elapsed = now_ns() - start;
+        printf("%d,%.1f\n", percent, elapsed / MEASURED_PAIRS);
+    }
+
+    free(ptrs);
+    deinit_allocator(&alloc);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/* Latency of get_size and free_size against the size of the allocation.
+
+   With 64 byte pages, allocations of 1 up to 2**20 pages are made one at a
+   time and their size looked up and freed again, repeatedly. Since sizes come
+   from the run length table, get_size should stay flat across sizes, and
+   free_size should only grow with the marking of the freed pages in the PAT
+   (32 pages per word).
+
+   build: cc -O2 -I.. bench_free_latency.c ../alloc.c -o bench_free_latency -lpthread
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define PAGE_SIZE 64
+#define MAX_PAGES_LOG2 20
+#define REPEATS 200
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+int main(void) {
+    uint32_t page_number = (uint32_t) 1 << (MAX_PAGES_LOG2 + 1);
+    allocator_options options = { BACKEND_MMAP, page_number };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, page_number, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return 1;
+    }
+
+    printf("pages,ns_per_get_size,ns_per_free\n");
+    for(int bits = 0; bits <= MAX_PAGES_LOG2; bits += 2) {
+        size_t size = ((size_t) PAGE_SIZE) << bits;
+        double size_time = 0, free_time = 0;
+        for(int r = 0; r < REPEATS; r++) {
+            void* ptr;
+            if(alloc_align_offset_zeroable(&alloc, size, 0, 0, false, &ptr) != SUCCESS) {
+                fprintf(stderr, "allocation failed\n");
+                return 1;
+            }
+            size_t actual;
+            double start = now_ns();
+            get_size(&alloc, ptr, &actual);
+            size_time += now_ns() - start;
+            start = now_ns();
+            free_size(&alloc, ptr, size);
+            free_time += now_ns() - start;
+        }
+        printf("%lu,%.1f,%.1f\n", 1ul << bits, size_time / REPEATS, free_time / REPEATS);
+    }
+
+    deinit_allocator(&alloc);
+    return 0;
+}
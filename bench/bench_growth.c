@@ -0,0 +1,139 @@
+/* Vector-style growth: two buffers doubled in turns, from 4 KiB to 256 MiB each.
+
+   Growing in turns keeps each buffer from growing over the pages after it, since the other one soon sits there, so
+   most steps need the free pages before it or a move. On an allocator of 4 KiB pages on the mmap backend, each
+   doubling is done by resize_oldsize_zeroable (which grows in place where it can, into free pages on both sides,
+   and remaps buffers of ALLOC_REMAP_MIN_BYTES and more), by resize_oldsize_zeroable_copy (always a new place and a
+   copy) and, as a baseline, by glibc realloc. The whole buffer is written after every step, untimed. Reported per
+   size are the median latency of a doubling over 5 rounds and the bytes the allocator copied and remapped for it
+   (from get_allocator_stats, not known for realloc), then the totals.
+
+   build: cc -O2 -I.. bench_growth.c ../alloc.c -o bench_growth -lpthread
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_NUMBER (1 << 19)
+#define FIRST_SIZE ((size_t) 4 << 10)
+#define LAST_SIZE ((size_t) 256 << 20)
+#define STEPS 16
+#define ROUNDS 5
+
+typedef enum growth_mode { GROW_RESIZE, GROW_COPY, GROW_REALLOC, MODES } growth_mode;
+static const char* mode_names[MODES] = { "resize", "resize_copy", "glibc_realloc" };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static void* grow(growth_mode mode, allocator* alloc, void* ptr, size_t old_size, size_t new_size) {
+    void* new_ptr = NULL;
+    if(mode == GROW_RESIZE) {
+        if(resize_oldsize_zeroable(alloc, ptr, old_size, new_size, 0, 0, false, false, &new_ptr) != SUCCESS) return NULL;
+    } else if(mode == GROW_COPY) {
+        if(resize_oldsize_zeroable_copy(alloc, ptr, old_size, new_size, 0, 0, false, &new_ptr) != SUCCESS) return NULL;
+    } else {
+        new_ptr = realloc(ptr, new_size);
+    }
+    return new_ptr;
+}
+
+/* one round: both buffers from FIRST_SIZE up, the latency and bytes moved of every doubling added up per step */
+static bool run_round(growth_mode mode, double* step_ns, uint64_t* step_copied, uint64_t* step_remapped) {
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    allocator alloc;
+    if(mode != GROW_REALLOC && init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return false;
+    }
+    void* buffers[2];
+    for(int b = 0; b < 2; b++) {
+        if(mode == GROW_REALLOC) buffers[b] = malloc(FIRST_SIZE);
+        else if(alloc_align_offset_zeroable(&alloc, FIRST_SIZE, 0, 0, false, &buffers[b]) != SUCCESS) buffers[b] = NULL;
+        if(buffers[b] == NULL) {
+            fprintf(stderr, "could not allocate the buffers\n");
+            return false;
+        }
+        memset(buffers[b], b + 1, FIRST_SIZE);
+    }
+
+    size_t size = FIRST_SIZE;
+    for(int step = 0; step < STEPS; step++) {
+        for(int b = 0; b < 2; b++) {
+            allocator_stats before, after;
+            if(mode != GROW_REALLOC) get_allocator_stats(&alloc, &before);
+            double start = now_ns();
+            void* grown = grow(mode, &alloc, buffers[b], size, size*2);
+            step_ns[step] += now_ns() - start;
+            if(grown == NULL) {
+                fprintf(stderr, "%s failed at %zu bytes\n", mode_names[mode], size*2);
+                return false;
+            }
+            buffers[b] = grown;
+            memset(&(((uint8_t*) grown)[size]), b + 1, size);
+            if(mode != GROW_REALLOC) {
+                get_allocator_stats(&alloc, &after);
+                step_copied[step] += after.resize_bytes_copied - before.resize_bytes_copied;
+                step_remapped[step] += after.resize_bytes_remapped - before.resize_bytes_remapped;
+            }
+        }
+        size *= 2;
+    }
+    for(int b = 0; b < 2; b++) {
+        if(((uint8_t*) buffers[b])[0] != b + 1 || ((uint8_t*) buffers[b])[LAST_SIZE - 1] != b + 1) fprintf(stderr, "%s lost data\n", mode_names[mode]);
+        if(mode == GROW_REALLOC) free(buffers[b]);
+    }
+    if(mode != GROW_REALLOC) deinit_allocator(&alloc);
+    return true;
+}
+
+int main(void) {
+    printf("mode,size_bytes,doubling_ns,bytes_copied,bytes_remapped\n");
+    for(int mode = 0; mode < MODES; mode++) {
+        double rounds_ns[STEPS][ROUNDS];
+        uint64_t copied[STEPS] = { 0 }, remapped[STEPS] = { 0 };
+        bool done = true;
+        for(int round = 0; round < ROUNDS && done; round++) {
+            double step_ns[STEPS] = { 0 };
+            uint64_t step_copied[STEPS] = { 0 }, step_remapped[STEPS] = { 0 };
+            done = run_round(mode, step_ns, step_copied, step_remapped);
+            for(int step = 0; step < STEPS; step++) {
+                rounds_ns[step][round] = step_ns[step] / 2;
+                /* the same in every round, the allocator being deterministic */
+                copied[step] = step_copied[step] / 2;
+                remapped[step] = step_remapped[step] / 2;
+            }
+        }
+        if(!done) continue;
+
+        double total_ns = 0;
+        uint64_t total_copied = 0, total_remapped = 0;
+        size_t size = FIRST_SIZE*2;
+        for(int step = 0; step < STEPS; step++) {
+            qsort(rounds_ns[step], ROUNDS, sizeof(double), compare_doubles);
+            double median = rounds_ns[step][ROUNDS / 2];
+            total_ns += median;
+            total_copied += copied[step];
+            total_remapped += remapped[step];
+            if(mode == GROW_REALLOC) printf("%s,%zu,%.0f,,\n", mode_names[mode], size, median);
+            else printf("%s,%zu,%.0f,%llu,%llu\n", mode_names[mode], size, median, (unsigned long long) copied[step], (unsigned long long) remapped[step]);
+            size *= 2;
+        }
+        if(mode == GROW_REALLOC) printf("%s,total,%.0f,,\n", mode_names[mode], total_ns);
+        else printf("%s,total,%.0f,%llu,%llu\n", mode_names[mode], total_ns, (unsigned long long) total_copied, (unsigned long long) total_remapped);
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* Random-access throughput over allocated buffers with and without huge pages.
+
+   For every huge page option, an allocator of 4 KiB pages on the mmap
+   backend gets buffers of 1 to 256 pages until the given number of MiB
+   (default 512) is allocated and written; then random 8 byte words all over
+   the buffers are read, dependent on each other so every read pays its full
+   latency including the TLB miss. Reported are the backing the allocator
+   ended up with (it falls back when huge pages are unavailable, e.g. an empty
+   hugetlbfs pool, see /proc/sys/vm/nr_hugepages) and the ns per read.
+
+   build: cc -O2 -I.. bench_huge_pages.c ../alloc.c -o bench_huge_pages -lpthread
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define MAX_BUFFERS 65536
+#define READS 20000000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    state[0] ^= state[0] << 13;
+    state[0] ^= state[0] >> 7;
+    state[0] ^= state[0] << 17;
+    return state[0];
+}
+
+static void run(const char* name, allocator_huge_pages huge_pages, size_t total_bytes) {
+    static uint64_t* buffers[MAX_BUFFERS];
+    static size_t words[MAX_BUFFERS];
+    uint32_t page_number = (uint32_t) ((total_bytes / PAGE_SIZE + 1024) / 4 * 4);
+    allocator_options options = { BACKEND_MMAP, page_number, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, huge_pages };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, page_number, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "%s: could not initialize the allocator\n", name);
+        return;
+    }
+
+    uint64_t state = 42;
+    uint32_t count = 0;
+    size_t allocated = 0;
+    while(count < MAX_BUFFERS && allocated < total_bytes) {
+        size_t size = (1 + next_random(&state) % 256) * PAGE_SIZE;
+        void* ptr;
+        if(alloc_align_offset_zeroable(&alloc, size, 0, 0, false, &ptr) != SUCCESS) break;
+        buffers[count] = ptr;
+        words[count] = size / sizeof(uint64_t);
+        for(size_t i = 0; i < words[count]; i++) buffers[count][i] = next_random(&state);
+        allocated += size;
+        count++;
+    }
+
+    uint64_t sum = 0;
+    double start = now_ns();
+    for(uint32_t r = 0; r < READS; r++) {
+        uint64_t random = next_random(&state) ^ (sum & 1);
+        uint32_t k = random % count;
+        sum += buffers[k][(random >> 32) % words[k]];
+    }
+    double elapsed = now_ns() - start;
+
+    const char* backing[] = { "regular", "transparent", "hugetlb" };
+    printf("%s,%s,%zu,%.2f,%llu\n", name, backing[alloc.huge_pages], allocated >> 20, elapsed / READS, (unsigned long long) (sum & 0xff));
+    deinit_allocator(&alloc);
+}
+
+int main(int argc, char** argv) {
+    size_t total_bytes = (size_t) (argc > 1 ? atoi(argv[1]) : 512) << 20;
+    printf("requested,backing,mib,ns_per_read,checksum\n");
+    run("none", HUGE_PAGES_NONE, total_bytes);
+    run("transparent", HUGE_PAGES_TRANSPARENT, total_bytes);
+    run("hugetlb", HUGE_PAGES_HUGETLB, total_bytes);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/* Scalar against word-at-a-time PAT kernels.
+
+   Three PAT patterns are generated: a heap that is 95% used with a few holes,
+   a fragmented heap of short allocations and holes, and a heap holding a few
+   huge allocations. On each, the kernels for finding a free run, counting the
+   continuation pages of an allocation and bulk-marking a range are timed.
+
+   build: cc -O2 -march=native -I.. bench_pat_kernels.c -o bench_pat_kernels
+*/
+
+#include "pat_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PAGE_NUMBER (1 << 22)
+#define REPETITIONS 64
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+/* lays out allocations of random length followed by holes of random length */
+static void fill_pattern(uint8_t *PAT, size_t max_allocation, size_t max_hole) {
+    size_t i = 0;
+    while(i < PAGE_NUMBER) {
+        size_t allocation = 1 + rand() % max_allocation;
+        if(i + allocation > PAGE_NUMBER) allocation = PAGE_NUMBER - i;
+        pat_set_range_scalar(PAT, i, i + allocation, 0x03);
+        pat_set_range_scalar(PAT, i, i + 1, 0x02);
+        i += allocation;
+        size_t hole = rand() % (max_hole + 1);
+        if(i + hole > PAGE_NUMBER) hole = PAGE_NUMBER - i;
+        pat_set_range_scalar(PAT, i, i + hole, rand() % 2);
+        i += hole;
+    }
+}
+
+static volatile size_t sink;
+
+static void run_pattern(const char* name, uint8_t *PAT) {
+    double start, scalar, words;
+    size_t out;
+
+    /* searching for a run longer than any hole walks the whole table */
+    start = now_ns();
+    for(int r = 0; r < REPETITIONS; r++) sink += pat_find_free_run_scalar(PAT, 0, PAGE_NUMBER, 1 << 16, &out);
+    scalar = now_ns() - start;
+    start = now_ns();
+    for(int r = 0; r < REPETITIONS; r++) sink += pat_find_free_run_words(PAT, 0, PAGE_NUMBER, 1 << 16, &out);
+    words = now_ns() - start;
+    printf("%s,find_free_run,%.3f,%.3f,%.2f\n", name, scalar/REPETITIONS/1e6, words/REPETITIONS/1e6, scalar/words);
+
+    size_t checksum_scalar = 0, checksum_words = 0;
+    start = now_ns();
+    for(int r = 0; r < REPETITIONS; r++) {
+        for(size_t i = pat_find_page_scalar(PAT, 0, PAGE_NUMBER, PAT_CONTINUATION); i < PAGE_NUMBER; ) {
+            size_t length = pat_extend_run_scalar(PAT, i, PAGE_NUMBER, PAT_CONTINUATION);
+            checksum_scalar += length;
+            i = pat_find_page_scalar(PAT, i + length, PAGE_NUMBER, PAT_CONTINUATION);
+        }
+    }
+    scalar = now_ns() - start;
+    start = now_ns();
+    for(int r = 0; r < REPETITIONS; r++) {
+        for(size_t i = pat_find_page_words(PAT, 0, PAGE_NUMBER, PAT_CONTINUATION); i < PAGE_NUMBER; ) {
+            size_t length = pat_extend_run_words(PAT, i, PAGE_NUMBER, PAT_CONTINUATION);
+            checksum_words += length;
+            i = pat_find_page_words(PAT, i + length, PAGE_NUMBER, PAT_CONTINUATION);
+        }
+    }
+    words = now_ns() - start;
+    if(checksum_scalar != checksum_words) fprintf(stderr, "%s: continuation counts differ!\n", name);
+    printf("%s,count_continuations,%.3f,%.3f,%.2f\n", name, scalar/REPETITIONS/1e6, words/REPETITIONS/1e6, scalar/words);
+
+    uint8_t *copy = malloc(PAGE_NUMBER / 4);
+    memcpy(copy, PAT, PAGE_NUMBER / 4);
+    start = now_ns();
+    for(int r = 0; r < REPETITIONS; r++) pat_set_range_scalar(copy, 7 + r, PAGE_NUMBER - 13 - r, r % 4);
+    scalar = now_ns() - start;
+    start = now_ns();
+    for(int r = 0; r < REPETITIONS; r++) pat_set_range_words(copy, 7 + r, PAGE_NUMBER - 13 - r, r % 4);
+    words = now_ns() - start;
+    printf("%s,set_range,%.3f,%.3f,%.2f\n", name, scalar/REPETITIONS/1e6, words/REPETITIONS/1e6, scalar/words);
+    free(copy);
+}
+
+int main(void) {
+    uint8_t *PAT = malloc(PAGE_NUMBER / 4);
+    srand(42);
+    printf("pattern,kernel,scalar_ms,words_ms,speedup\n");
+
+    fill_pattern(PAT, 64, 3);
+    run_pattern("mostly_full", PAT);
+
+    fill_pattern(PAT, 8, 8);
+    run_pattern("fragmented", PAT);
+
+    fill_pattern(PAT, 1 << 18, 16);
+    run_pattern("huge_allocations", PAT);
+
+    free(PAT);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/* Allocation latency and fragmentation of the placement policies on a trace.
+
+   The trace is either read from the file given as the first argument, one
+   operation per line ("a <id> <bytes>" to allocate, "f <id>" to free, ids
+   below 1000000), or generated: a mix of long-lived buffers that stay for
+   thousands of operations and short-lived ones that go again after a few
+   dozen, with log-uniform sizes from 1 to 128 pages. Every policy replays the
+   same trace on a fresh allocator of 32768 pages of 4 KiB; reported are
+   the mean allocation latency, the failed allocations and the fragmentation,
+   1 - (largest free run / free pages), averaged over samples along the trace.
+
+   build: cc -O2 -I.. bench_placement.c ../alloc.c -o bench_placement -lpthread -lm
+*/
+
+#include "alloc.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_NUMBER (1 << 15)
+#define MAX_IDS 1000000
+#define GENERATED_OPERATIONS 400000
+#define SAMPLE_EVERY 1000
+
+typedef struct operation {
+    uint32_t id;
+    size_t size;  /* 0 for a free */
+} operation;
+
+static operation *trace;
+static size_t trace_length;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static void add_operation(uint32_t id, size_t size) {
+    static size_t capacity;
+    if(trace_length == capacity) {
+        capacity = capacity ? capacity*2 : 4096;
+        trace = realloc(trace, capacity*sizeof(operation));
+        if(trace == NULL) exit(1);
+    }
+    trace[trace_length].id = id;
+    trace[trace_length].size = size;
+    trace_length++;
+}
+
+static int read_trace(const char* path) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) return 0;
+    char kind;
+    unsigned long id, size;
+    while(fscanf(file, " %c %lu", &kind, &id) == 2) {
+        if(id >= MAX_IDS) continue;
+        if(kind == 'a' && fscanf(file, " %lu", &size) == 1 && size != 0) add_operation((uint32_t) id, size);
+        else if(kind == 'f') add_operation((uint32_t) id, 0);
+    }
+    fclose(file);
+    return 1;
+}
+
+/* frees are scheduled by the lifetime drawn at allocation, long-lived buffers stay 5000-20000 operations */
+static void generate_trace(void) {
+    static uint32_t due_first[GENERATED_OPERATIONS + 20001];  /* per step, the ids to free then, chained through due_next */
+    static uint32_t due_next[MAX_IDS];
+    srand(42);
+    for(uint32_t step = 0, id = 1; step < GENERATED_OPERATIONS && id < MAX_IDS; step++, id++) {
+        for(uint32_t due = due_first[step]; due != 0; due = due_next[due]) add_operation(due, 0);
+        bool long_lived = rand() % 20 == 0;
+        size_t pages = (size_t) exp2(7.0 * rand() / RAND_MAX);
+        add_operation(id, pages*PAGE_SIZE - rand() % PAGE_SIZE);
+        uint32_t free_step = step + 1 + (long_lived ? 5000 + rand() % 15000 : rand() % 64);
+        due_next[id] = due_first[free_step];
+        due_first[free_step] = id;
+    }
+}
+
+static double fragmentation(const allocator* p_alloc) {
+    size_t free_pages = 0, largest = 0, run = 0;
+    for(uint32_t i = 0; i < p_alloc->allocated_pages; i++) {
+        if(((p_alloc->PAT[i/4] >> (i%4)*2) & 0x2) == 0) {
+            free_pages++;
+            run++;
+            if(run > largest) largest = run;
+        } else {
+            run = 0;
+        }
+    }
+    return (free_pages == 0) ? 0.0 : 1.0 - (double) largest / free_pages;
+}
+
+static void replay(const char* name, allocator_placement placement) {
+    static void* ptrs[MAX_IDS];
+    static size_t sizes[MAX_IDS];
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, false, NULL, placement };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "%s: could not initialize the allocator\n", name);
+        return;
+    }
+
+    double alloc_time = 0, fragmentation_sum = 0;
+    size_t allocations = 0, failures = 0, samples = 0;
+    for(size_t i = 0; i < trace_length; i++) {
+        uint32_t id = trace[i].id;
+        if(trace[i].size == 0) {
+            if(ptrs[id] != NULL) free_size(&alloc, ptrs[id], sizes[id]);
+            ptrs[id] = NULL;
+        } else {
+            double start = now_ns();
+            alloc_result result = alloc_align_offset_zeroable(&alloc, trace[i].size, 0, 0, false, &ptrs[id]);
+            alloc_time += now_ns() - start;
+            allocations++;
+            if(result != SUCCESS) {
+                ptrs[id] = NULL;
+                failures++;
+            }
+            sizes[id] = trace[i].size;
+        }
+        if(i % SAMPLE_EVERY == 0) {
+            fragmentation_sum += fragmentation(&alloc);
+            samples++;
+        }
+    }
+    printf("%s,%.1f,%zu,%.3f\n", name, alloc_time / allocations, failures, fragmentation_sum / samples);
+
+    for(uint32_t id = 0; id < MAX_IDS; id++) ptrs[id] = NULL;
+    deinit_allocator(&alloc);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        if(!read_trace(argv[1])) {
+            fprintf(stderr, "could not read the trace %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        generate_trace();
+    }
+
+    printf("policy,ns_per_alloc,failed_allocations,mean_fragmentation\n");
+    replay("first_fit", PLACEMENT_FIRST_FIT);
+    replay("next_fit", PLACEMENT_NEXT_FIT);
+    replay("best_fit", PLACEMENT_BEST_FIT);
+    replay("segregated_fit", PLACEMENT_SEGREGATED_FIT);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/* RSS over a spike-then-idle workload, and the latency purging adds.
+
+   Every configuration runs the same workload on a fresh allocator of 4 KiB
+   pages on the mmap backend: a baseline of 32 MiB of buffers, a spike to
+   512 MiB (written, so it is resident), then back to the baseline, followed
+   by two seconds of light traffic (an allocation and a free of 1 to 64 pages
+   every 100 us). The RSS of the process is sampled every 50 ms and printed
+   as a curve per configuration, followed by the mean and worst latency of
+   the allocation and free calls, which include the purge steps.
+
+   build: cc -O2 -I.. bench_purge.c ../alloc.c -o bench_purge -lpthread
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_NUMBER (1 << 18)
+#define BASELINE_BYTES ((size_t) 32 << 20)
+#define SPIKE_BYTES ((size_t) 512 << 20)
+#define IDLE_NS 2000000000.0
+#define IDLE_GAP_US 100
+#define SAMPLE_NS 50000000.0
+#define MAX_BUFFERS 16384
+
+typedef struct buffer {
+    void* ptr;
+    size_t size;
+} buffer;
+
+static buffer buffers[MAX_BUFFERS];
+static uint32_t buffer_count;
+static double op_time, op_max;
+static size_t ops;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static double rss_mib(void) {
+    FILE *file = fopen("/proc/self/statm", "r");
+    unsigned long size = 0, resident = 0;
+    if(file == NULL) return 0;
+    if(fscanf(file, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(file);
+    return (double) resident * sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+static void timed(double start) {
+    double elapsed = now_ns() - start;
+    op_time += elapsed;
+    if(elapsed > op_max) op_max = elapsed;
+    ops++;
+}
+
+static bool push(allocator* p_alloc, size_t size) {
+    void* ptr;
+    double start = now_ns();
+    alloc_result result = alloc_align_offset_zeroable(p_alloc, size, 0, 0, false, &ptr);
+    timed(start);
+    if(result != SUCCESS || buffer_count == MAX_BUFFERS) return false;
+    memset(ptr, 1, size);
+    buffers[buffer_count].ptr = ptr;
+    buffers[buffer_count].size = size;
+    buffer_count++;
+    return true;
+}
+
+static void pop_random(allocator* p_alloc) {
+    uint32_t k = rand() % buffer_count;
+    double start = now_ns();
+    free_size(p_alloc, buffers[k].ptr, buffers[k].size);
+    timed(start);
+    buffers[k] = buffers[--buffer_count];
+}
+
+static size_t live_bytes(void) {
+    size_t bytes = 0;
+    for(uint32_t k = 0; k < buffer_count; k++) bytes += buffers[k].size;
+    return bytes;
+}
+
+static void run(const char* name, uint32_t watermark_pages, uint32_t decay_ms) {
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, watermark_pages, decay_ms };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "%s: could not initialize the allocator\n", name);
+        return;
+    }
+    srand(42);
+    buffer_count = 0;
+    op_time = op_max = 0;
+    ops = 0;
+    double begin = now_ns(), next_sample = begin;
+
+    /* baseline, spike and back, sampled between the phases */
+    while(live_bytes() < BASELINE_BYTES && push(&alloc, (1 + rand() % 64) * PAGE_SIZE)) ;
+    printf("%s,%.0f,%.1f\n", name, (now_ns() - begin) / 1e6, rss_mib());
+    while(live_bytes() < SPIKE_BYTES && push(&alloc, (1 + rand() % 64) * PAGE_SIZE)) ;
+    printf("%s,%.0f,%.1f\n", name, (now_ns() - begin) / 1e6, rss_mib());
+    while(live_bytes() > BASELINE_BYTES) pop_random(&alloc);
+    printf("%s,%.0f,%.1f\n", name, (now_ns() - begin) / 1e6, rss_mib());
+
+    double idle_start = now_ns();
+    next_sample = idle_start + SAMPLE_NS;
+    while(now_ns() - idle_start < IDLE_NS) {
+        push(&alloc, (1 + rand() % 64) * PAGE_SIZE);
+        pop_random(&alloc);
+        usleep(IDLE_GAP_US);
+        if(now_ns() >= next_sample) {
+            printf("%s,%.0f,%.1f\n", name, (now_ns() - begin) / 1e6, rss_mib());
+            next_sample += SAMPLE_NS;
+        }
+    }
+
+    allocator_stats stats;
+    get_allocator_stats(&alloc, &stats);
+    fprintf(stderr, "%s: %.1f ns per call, worst %.1f us, %llu pages purged\n", name, op_time / ops, op_max / 1e3, (unsigned long long) stats.pages_purged);
+    deinit_allocator(&alloc);
+}
+
+int main(void) {
+    printf("configuration,time_ms,rss_mib\n");
+    run("no_purge", 0, 0);
+    run("watermark_64mib", (64 << 20) / PAGE_SIZE, 0);
+    run("decay_500ms", 0, 500);
+    run("watermark_and_decay", (64 << 20) / PAGE_SIZE, 500);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/* Attach time of a shared allocator against heap size, compared with rebuilding the heap.
+
+   For every heap size, a shared allocator of 4 KiB pages is made in a file
+   (in /dev/shm, or the directory given as the first argument) and filled to
+   about 75% with allocations of 1 to 16 pages holding data, linked from a
+   table whose offset is the root. Attaching then maps the file, follows the
+   root and reads the first word of every allocation; rebuilding instead makes
+   a private allocator and allocates and copies every allocation again, which
+   is what a restarted process would have to do without the shared heap.
+
+   build: cc -O2 -I.. bench_shared_attach.c ../alloc.c -o bench_shared_attach -lpthread
+*/
+
+#include "alloc.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SIZE 4096
+
+typedef struct entry {
+    alloc_offset offset;
+    size_t size;
+} entry;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static void run(const char* directory, uint32_t heap_mib) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/bench_shared_attach.%d", directory, (int) getpid());
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0) {
+        fprintf(stderr, "could not create %s\n", path);
+        return;
+    }
+    unlink(path);
+    uint32_t page_number = ((uint32_t) heap_mib << 20) / PAGE_SIZE;
+    allocator shared;
+    if(init_allocator_shared(PAGE_SIZE, page_number, fd, NULL, NULL, &shared) != SUCCESS) {
+        fprintf(stderr, "could not initialize the shared allocator of %u MiB\n", heap_mib);
+        close(fd);
+        return;
+    }
+
+    /* the table of all allocations lives in the heap too, so the root is all an attaching process needs */
+    uint32_t max_entries = page_number / 4;
+    entry *table;
+    alloc_align_offset_zeroable(&shared, max_entries*sizeof(entry), 0, 0, true, (void**) &table);
+    uint32_t count = 0;
+    size_t used = max_entries*sizeof(entry), target = (size_t) page_number*PAGE_SIZE / 4 * 3;
+    srand(42);
+    while(count < max_entries && used < target) {
+        size_t size = (1 + rand() % 16) * PAGE_SIZE;
+        void* ptr;
+        if(alloc_align_offset_zeroable(&shared, size, 0, 0, false, &ptr) != SUCCESS) break;
+        memset(ptr, count & 0xff, size);
+        table[count].offset = offset_from_pointer(&shared, ptr);
+        table[count].size = size;
+        count++;
+        used += size;
+    }
+    set_shared_root(&shared, offset_from_pointer(&shared, table));
+    deinit_allocator(&shared);
+
+    uint64_t checksum = 0;
+    double start = now_ns();
+    allocator attached;
+    if(attach_allocator_shared(fd, NULL, &attached) != SUCCESS) {
+        fprintf(stderr, "could not attach to the shared allocator\n");
+        close(fd);
+        return;
+    }
+    entry *attached_table = pointer_from_offset(&attached, get_shared_root(&attached));
+    for(uint32_t k = 0; k < count; k++) checksum += ((uint8_t*) pointer_from_offset(&attached, attached_table[k].offset))[0];
+    double attach_time = now_ns() - start;
+
+    /* rebuilding: the same allocations in a fresh private allocator, with their contents copied over */
+    start = now_ns();
+    allocator_options options = { BACKEND_MMAP, page_number, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    allocator rebuilt;
+    init_allocator_options(PAGE_SIZE, page_number, &options, NULL, &rebuilt);
+    for(uint32_t k = 0; k < count; k++) {
+        void* ptr;
+        if(alloc_align_offset_zeroable(&rebuilt, attached_table[k].size, 0, 0, false, &ptr) != SUCCESS) break;
+        memcpy(ptr, pointer_from_offset(&attached, attached_table[k].offset), attached_table[k].size);
+        checksum += ((uint8_t*) ptr)[0];
+    }
+    double rebuild_time = now_ns() - start;
+
+    printf("%u,%u,%.1f,%.1f,%llu\n", heap_mib, count, attach_time / 1e3, rebuild_time / 1e3, (unsigned long long) (checksum & 0xff));
+    deinit_allocator(&rebuilt);
+    deinit_allocator(&attached);
+    close(fd);
+}
+
+int main(int argc, char** argv) {
+    const char* directory = (argc > 1) ? argv[1] : "/dev/shm";
+    printf("heap_mib,allocations,attach_us,rebuild_us,checksum\n");
+    for(uint32_t heap_mib = 16; heap_mib <= 1024; heap_mib *= 4) run(directory, heap_mib);
+    return 0;
+}
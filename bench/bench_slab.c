@@ -0,0 +1,117 @@
+/* Small-object churn through the slab layer against plain page allocation.
+
+   A pool of live objects of 16-48 bytes is kept, and every step frees a random
+   one and allocates a new one in its place. The slab layer runs on an allocator
+   with 4 KiB pages; plain page allocation uses the smallest pages there are,
+   64 bytes. Reported are the throughput and the bytes taken from the page
+   allocator per requested byte at the end (whole slabs, or whole pages).
+
+   build: cc -O2 -I.. bench_slab.c ../alloc.c ../slab.c -o bench_slab -lpthread
+*/
+
+#include "slab.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define POOL_SIZE 100000
+#define STEPS 2000000
+#define RESERVED_BYTES ((size_t) 1 << 30)
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static void* ptrs[POOL_SIZE];
+static size_t sizes[POOL_SIZE];
+
+static size_t random_size(void) {
+    return 16 + rand() % 33;
+}
+
+static void report(const char* name, double elapsed, double used_bytes) {
+    double requested = 0;
+    for(int i = 0; i < POOL_SIZE; i++) requested += sizes[i];
+    printf("%s,%.1f,%.0f,%.3f\n", name, STEPS / (elapsed / 1e9) / 1e3, used_bytes, used_bytes / requested);
+}
+
+static void run_slab(void) {
+    allocator_options options = { BACKEND_MMAP, (uint32_t) (RESERVED_BYTES / 4096) };
+    allocator alloc;
+    slab_allocator slab;
+    if(init_allocator_options(4096, 4096, &options, NULL, &alloc) != SUCCESS || init_slab_allocator(&alloc, 0, NULL, &slab) != SUCCESS) {
+        fprintf(stderr, "slab: could not initialize the allocators\n");
+        return;
+    }
+
+    srand(42);
+    for(int i = 0; i < POOL_SIZE; i++) {
+        sizes[i] = random_size();
+        if(slab_alloc_align_offset_zeroable(&slab, sizes[i], 0, 0, false, &ptrs[i]) != SUCCESS) {
+            fprintf(stderr, "slab: allocation failed\n");
+            return;
+        }
+    }
+    double start = now_ns();
+    for(int step = 0; step < STEPS; step++) {
+        int i = rand() % POOL_SIZE;
+        slab_free_size(&slab, ptrs[i], sizes[i]);
+        sizes[i] = random_size();
+        if(slab_alloc_align_offset_zeroable(&slab, sizes[i], 0, 0, false, &ptrs[i]) != SUCCESS) {
+            fprintf(stderr, "slab: allocation failed\n");
+            return;
+        }
+    }
+    report("slab_4KiB_pages", now_ns() - start, (double) slab.slab_count * slab.slab_bytes);
+
+    deinit_slab_allocator(&slab);
+    deinit_allocator(&alloc);
+}
+
+static void run_pages(void) {
+    allocator_options options = { BACKEND_MMAP, (uint32_t) (RESERVED_BYTES / 64) };
+    allocator alloc;
+    if(init_allocator_options(64, POOL_SIZE*2, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "pages: could not initialize the allocator\n");
+        return;
+    }
+
+    srand(42);
+    for(int i = 0; i < POOL_SIZE; i++) {
+        sizes[i] = random_size();
+        if(alloc_align_offset_zeroable(&alloc, sizes[i], 0, 0, false, &ptrs[i]) != SUCCESS) {
+            fprintf(stderr, "pages: allocation failed\n");
+            return;
+        }
+    }
+    double start = now_ns();
+    for(int step = 0; step < STEPS; step++) {
+        int i = rand() % POOL_SIZE;
+        free_size(&alloc, ptrs[i], sizes[i]);
+        sizes[i] = random_size();
+        if(alloc_align_offset_zeroable(&alloc, sizes[i], 0, 0, false, &ptrs[i]) != SUCCESS) {
+            fprintf(stderr, "pages: allocation failed\n");
+            return;
+        }
+    }
+    double elapsed = now_ns() - start;
+    double used = 0;
+    for(int i = 0; i < POOL_SIZE; i++) {
+        size_t actual;
+        get_size(&alloc, ptrs[i], &actual);
+        used += actual;
+    }
+    report("pages_64B", elapsed, used);
+
+    deinit_allocator(&alloc);
+}
+
+int main(void) {
+    printf("allocator,kops_per_s,used_bytes,used_per_requested\n");
+    run_slab();
+    run_pages();
+    return 0;
+}
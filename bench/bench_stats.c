@@ -0,0 +1,144 @@
+/* Overhead of the live statistics, and the cost of a heap map.
+
+   Build it twice, with the counters and without them:
+
+       cc -O2 -I.. bench_stats.c ../alloc.c -o bench_stats -lpthread
+       cc -O2 -I.. -DALLOC_NO_STATS bench_stats.c ../alloc.c -o bench_stats_off -lpthread
+
+   Both run the same churn on an allocator of 4 KiB pages on the mmap backend:
+   allocations of 1 to 16 pages and frees of random live ones, one thread on a
+   plain allocator and four threads on a concurrent one, reported in wall
+   clock ns per call. Then an arena of 262144 pages (1 GiB) is filled and
+   every third allocation freed, and get_heap_map is timed against a
+   page-by-page walk that builds the same histogram.
+
+   build: see above
+*/
+
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_NUMBER (1 << 18)
+#define CALLS 2000000
+#define SLOTS 1024
+#define THREADS 4
+#define MAP_ROUNDS 20
+
+#ifdef ALLOC_NO_STATS
+#define BUILD "stats_off"
+#else
+#define BUILD "stats_on"
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static void* churn(void* arg) {
+    allocator *alloc = arg;
+    void* slots[SLOTS] = { NULL };
+    size_t sizes[SLOTS];
+    unsigned seed = (unsigned) (size_t) &slots;
+    for(int call = 0; call < CALLS / THREADS; call++) {
+        uint32_t k = rand_r(&seed) % SLOTS;
+        if(slots[k] != NULL) {
+            free_size(alloc, slots[k], sizes[k]);
+            slots[k] = NULL;
+        } else {
+            sizes[k] = (size_t) (1 + rand_r(&seed) % 16) * PAGE_SIZE;
+            if(alloc_align_offset_zeroable(alloc, sizes[k], 0, 0, false, &slots[k]) != SUCCESS) slots[k] = NULL;
+        }
+    }
+    for(uint32_t k = 0; k < SLOTS; k++) if(slots[k] != NULL) free_size(alloc, slots[k], sizes[k]);
+    return NULL;
+}
+
+static void run_churn(bool concurrent) {
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, concurrent, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return;
+    }
+    int threads = concurrent ? THREADS : 1;
+    pthread_t workers[THREADS];
+    double start = now_ns();
+    for(int t = 0; t < threads; t++) pthread_create(&workers[t], NULL, churn, &alloc);
+    for(int t = 0; t < threads; t++) pthread_join(workers[t], NULL);
+    double elapsed = now_ns() - start;
+    printf("%s,churn_%d_threads_ns_per_call,%.1f\n", BUILD, threads, elapsed / ((double) (CALLS / THREADS) * threads));
+    deinit_allocator(&alloc);
+}
+
+/* the reference: every page looked at on its own */
+static void walk_heap_map(const allocator* p_alloc, allocator_heap_map* out_map) {
+    uint32_t run = 0;
+    memset(out_map, 0, sizeof(allocator_heap_map));
+    for(uint32_t i = 0; i <= p_alloc->allocated_pages; i++) {
+        if(i < p_alloc->allocated_pages && ((p_alloc->PAT[i/4] >> (i%4)*2) & 0x2) == 0) {
+            run++;
+            continue;
+        }
+        if(run == 0) continue;
+        int k = 0;
+        while(k + 1 < ALLOC_HEAP_MAP_CLASSES && (run >> (k + 1)) != 0) k++;
+        out_map->free_runs[k]++;
+        out_map->free_run_count++;
+        out_map->free_pages += run;
+        if(run > out_map->largest_free_run) out_map->largest_free_run = run;
+        run = 0;
+    }
+}
+
+static void run_heap_map(void) {
+    allocator_options options = { BACKEND_MMAP, PAGE_NUMBER, ZEROING_EAGER, false, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    allocator alloc;
+    if(init_allocator_options(PAGE_SIZE, PAGE_NUMBER, &options, NULL, &alloc) != SUCCESS) {
+        fprintf(stderr, "could not initialize the allocator\n");
+        return;
+    }
+    static void* ptrs[PAGE_NUMBER];
+    static size_t sizes[PAGE_NUMBER];
+    uint32_t count = 0;
+    srand(42);
+    for(;;) {
+        sizes[count] = 1 + (size_t) (rand() % 64) * PAGE_SIZE + rand() % PAGE_SIZE;
+        if(alloc_align_offset_zeroable(&alloc, sizes[count], 0, 0, false, &ptrs[count]) != SUCCESS) break;
+        count++;
+    }
+    for(uint32_t k = 0; k < count; k += 3) free_size(&alloc, ptrs[k], sizes[k]);
+
+    allocator_heap_map map, reference;
+    double start = now_ns();
+    for(int round = 0; round < MAP_ROUNDS; round++) get_heap_map(&alloc, &map);
+    double map_time = (now_ns() - start) / MAP_ROUNDS;
+    start = now_ns();
+    for(int round = 0; round < MAP_ROUNDS; round++) walk_heap_map(&alloc, &reference);
+    double walk_time = (now_ns() - start) / MAP_ROUNDS;
+    if(map.free_run_count != reference.free_run_count || map.largest_free_run != reference.largest_free_run) fprintf(stderr, "the heap maps differ\n");
+
+    allocator_stats stats;
+    get_allocator_stats(&alloc, &stats);
+    printf("%s,heap_map_us,%.1f\n", BUILD, map_time / 1e3);
+    printf("%s,page_walk_us,%.1f\n", BUILD, walk_time / 1e3);
+    fprintf(stderr, "%s: %llu free runs, largest %u pages; %llu allocations live, %llu of %llu bytes requested\n", BUILD,
+        (unsigned long long) map.free_run_count, map.largest_free_run, (unsigned long long) stats.live_allocations,
+        (unsigned long long) stats.bytes_requested, (unsigned long long) stats.bytes_rounded);
+    deinit_allocator(&alloc);
+}
+
+int main(void) {
+    printf("build,measure,value\n");
+    run_churn(false);
+    run_churn(true);
+    run_heap_map();
+    return 0;
+}
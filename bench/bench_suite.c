@@ -0,0 +1,704 @@
+/* Allocation workloads against the page allocator and malloc baselines, for comparing versions.
+
+   usage: bench_suite [-f csv|json] [-n calls] [-p page_size] [-m heap_mib] [<replay> ...]
+          bench_suite -c <old.csv> <new.csv> [percent]
+
+   Every workload runs on each target in a child process of its own. The targets are the page allocator (mmap backend,
+   heap_mib MiB of page_size pages, 2048 MiB of 256 bytes by default), glibc malloc, and jemalloc and mimalloc if their
+   shared libraries can be dlopen'd. The synthetic workloads make about calls calls (1000000 by default):
+
+       uniform            4096 slots, picked at random: an empty one gets an allocation of 1 byte to 64 KiB, a live
+                          one is resized (2 in 8), asked for its size (1 in 8) or freed (5 in 8); 1 in 8 allocations
+                          is zeroed
+       power_law          the same with Pareto sizes (alpha 1.1) from 64 bytes up to 4 MiB
+       producer_consumer  one thread allocates power-law sizes and passes them through a queue of 4096 to another
+                          thread, which asks for the size and frees them, so every allocation is freed by another
+                          thread (the page allocator is concurrent for this one)
+
+   and each replay file (written by tools/alloc_trace_decode from a trace dump) is run as its own workload, with the
+   page size it was recorded at. The timed calls are alloc_align_offset_zeroable, resize_oldsize_zeroable, free_size
+   and get_size, or malloc/calloc/posix_memalign, realloc, free and malloc_usable_size. One byte of every 4 KiB of new
+   memory is written between the calls, untimed, so the resident memory is comparable.
+
+   On stdout goes one row per target, workload and operation: calls, failures, latency percentiles in ns, the calls per
+   second of wall time for the whole workload, the peak resident memory it added (from VmHWM, reset through
+   /proc/self/clear_refs), the bytes asked for and the usable bytes (get_size) of the allocations still live at the
+   end, and for the page allocator the share of its free pages outside the largest free run (get_heap_map) at that
+   point. With -c, two such CSV files are compared and the rows whose p99 latency or peak memory grew, or whose calls
+   per second dropped, by more than percent (10 by default) are listed; the exit status is 1 if there are any.
+
+   build: make -C bench bench_suite
+*/
+
+#define _GNU_SOURCE
+
+#include "alloc.h"
+
+#include <dlfcn.h>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_CALLS 1000000
+#define DEFAULT_PAGE_SIZE 256
+#define DEFAULT_HEAP_MIB 2048
+#define SLOTS 4096
+#define QUEUE_SLOTS 4096
+#define UNIFORM_MAX_SIZE (64 << 10)
+#define POWER_LAW_MIN_SIZE 64
+#define POWER_LAW_MAX_SIZE (4 << 20)
+#define POWER_LAW_ALPHA 1.1
+#define TOUCH_STRIDE 4096
+
+typedef enum bench_op { OP_ALLOC, OP_RESIZE, OP_FREE, OP_GET_SIZE, OPS } bench_op;
+static const char* op_names[OPS] = { "alloc", "resize", "free", "get_size" };
+
+/* the page allocator, or a malloc implementation through its functions */
+typedef struct target {
+    const char* name;
+    bool paged;
+    allocator heap;
+    void* (*malloc_fn)(size_t);
+    void* (*calloc_fn)(size_t, size_t);
+    void* (*realloc_fn)(void*, size_t);
+    void (*free_fn)(void*);
+    size_t (*usable_size_fn)(void*);
+    int (*posix_memalign_fn)(void**, size_t, size_t);
+} target;
+
+typedef struct latencies {
+    uint32_t *durations;
+    size_t count;
+    size_t failed;
+} latencies;
+
+typedef struct run_result {
+    latencies ops[OPS];
+    size_t capacity;  /* of every durations array */
+    double seconds;
+    long peak_rss_kib;
+    size_t live_bytes;
+    size_t usable_bytes;
+    double free_run_fragmentation;  /* negative if unknown */
+} run_result;
+
+typedef struct trace_op {
+    char kind;  /* 'a', 'r' or 'f' */
+    uint8_t alignment_bits;
+    bool zeroed;
+    uint32_t id;
+    size_t size;
+} trace_op;
+
+typedef struct workload {
+    char name[128];
+    void (*run)(target* t, const struct workload* w, run_result* result);
+    uint32_t page_size;
+    bool concurrent;
+    trace_op *ops;  /* replays only */
+    size_t op_count;
+    uint32_t ids;
+} workload;
+
+typedef struct slot {
+    void* ptr;
+    size_t size;
+} slot;
+
+static size_t calls = DEFAULT_CALLS;
+static uint32_t page_size = DEFAULT_PAGE_SIZE;
+static size_t heap_mib = DEFAULT_HEAP_MIB;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static inline void record(run_result* result, bench_op op, uint64_t start, bool failed) {
+    uint64_t duration = now_ns() - start;
+    latencies *l = &(result->ops[op]);
+    if(l->count < result->capacity) l->durations[l->count++] = (duration > UINT32_MAX) ? UINT32_MAX : (uint32_t) duration;
+    if(failed) l->failed++;
+}
+
+static inline void touch(void* ptr, size_t from, size_t to) {
+    for(size_t k = from; k < to; k += TOUCH_STRIDE) ((volatile uint8_t*) ptr)[k] = 1;
+}
+
+
+/* targets */
+
+static void* target_alloc(target* t, size_t size, int alignment_bits, bool zeroed) {
+    void* ptr = NULL;
+    if(t->paged) return (alloc_align_offset_zeroable(&(t->heap), size, alignment_bits, 0, zeroed, &ptr) == SUCCESS) ? ptr : NULL;
+    if(alignment_bits > 4) {
+        if(t->posix_memalign_fn(&ptr, (size_t) 1 << alignment_bits, size) != 0) return NULL;
+        if(zeroed) memset(ptr, 0, size);
+        return ptr;
+    }
+    return zeroed ? t->calloc_fn(1, size) : t->malloc_fn(size);
+}
+
+/* realloc keeps no alignment above its default, the page allocator is asked to keep the original one */
+static void* target_resize(target* t, void* ptr, size_t old_size, size_t new_size, int alignment_bits) {
+    void* new_ptr = NULL;
+    if(t->paged) return (resize_oldsize_zeroable(&(t->heap), ptr, old_size, new_size, alignment_bits, 0, true, false, &new_ptr) == SUCCESS) ? new_ptr : NULL;
+    return t->realloc_fn(ptr, new_size);
+}
+
+static bool target_free(target* t, void* ptr, size_t size) {
+    if(t->paged) return free_size(&(t->heap), ptr, size) == SUCCESS;
+    t->free_fn(ptr);
+    return true;
+}
+
+static size_t target_get_size(target* t, void* ptr) {
+    size_t size = 0;
+    if(t->paged) return (get_size(&(t->heap), ptr, &size) == SUCCESS) ? size : 0;
+    return t->usable_size_fn(ptr);
+}
+
+static bool target_start(target* t, const workload* w) {
+    if(!t->paged) return true;
+    allocator_options options = { BACKEND_MMAP, 0, ZEROING_EAGER, w->concurrent, NULL, PLACEMENT_FIRST_FIT, HUGE_PAGES_NONE, 0, 0 };
+    size_t pages = (heap_mib << 20) / w->page_size;
+    if(pages > UINT32_MAX / 2) pages = UINT32_MAX / 2;
+    options.reserved_pages = (uint32_t) pages;
+    if(init_allocator_options(w->page_size, (uint32_t) pages, &options, NULL, &(t->heap)) != SUCCESS) {
+        fprintf(stderr, "could not initialize a page allocator of %zu pages of %u bytes\n", pages, w->page_size);
+        return false;
+    }
+    return true;
+}
+
+/* the live allocations at the end of a run, then everything is freed */
+static void target_finish(target* t, slot* slots, size_t count, run_result* result) {
+    result->free_run_fragmentation = -1;
+    if(t->paged) {
+        allocator_heap_map map;
+        if(get_heap_map(&(t->heap), &map) == SUCCESS) {
+            result->free_run_fragmentation = (map.free_pages == 0) ? 0 : 1 - (double) map.largest_free_run / (double) map.free_pages;
+        }
+    }
+    for(size_t k = 0; k < count; k++) {
+        if(slots[k].ptr == NULL) continue;
+        result->live_bytes += slots[k].size;
+        result->usable_bytes += target_get_size(t, slots[k].ptr);
+        target_free(t, slots[k].ptr, slots[k].size);
+        slots[k].ptr = NULL;
+    }
+    if(t->paged) deinit_allocator(&(t->heap));
+}
+
+static void glibc_target(target* t) {
+    memset(t, 0, sizeof(target));
+    t->name = "glibc";
+    t->malloc_fn = malloc;
+    t->calloc_fn = calloc;
+    t->realloc_fn = realloc;
+    t->free_fn = free;
+    t->usable_size_fn = malloc_usable_size;
+    t->posix_memalign_fn = posix_memalign;
+}
+
+static void* library_symbol(void* library, const char* prefix, const char* name) {
+    char symbol[64];
+    snprintf(symbol, sizeof(symbol), "%s%s", prefix, name);
+    return dlsym(library, symbol);
+}
+
+/* a malloc implementation from a shared library, with its functions named prefix + the standard name */
+static bool library_target(target* t, const char* name, const char* const* files, const char* const* prefixes, const char* usable_size) {
+    memset(t, 0, sizeof(target));
+    t->name = name;
+    void* library = NULL;
+    for(int k = 0; files[k] != NULL && library == NULL; k++) library = dlopen(files[k], RTLD_NOW | RTLD_LOCAL);
+    if(library == NULL) return false;
+    for(int k = 0; prefixes[k] != NULL; k++) {
+        /* casts through uintptr_t, as ISO C has no conversion from void* to function pointers */
+        t->malloc_fn = (void* (*)(size_t)) (uintptr_t) library_symbol(library, prefixes[k], "malloc");
+        t->calloc_fn = (void* (*)(size_t, size_t)) (uintptr_t) library_symbol(library, prefixes[k], "calloc");
+        t->realloc_fn = (void* (*)(void*, size_t)) (uintptr_t) library_symbol(library, prefixes[k], "realloc");
+        t->free_fn = (void (*)(void*)) (uintptr_t) library_symbol(library, prefixes[k], "free");
+        t->usable_size_fn = (size_t (*)(void*)) (uintptr_t) library_symbol(library, prefixes[k], usable_size);
+        t->posix_memalign_fn = (int (*)(void**, size_t, size_t)) (uintptr_t) library_symbol(library, prefixes[k], "posix_memalign");
+        if(t->malloc_fn != NULL && t->calloc_fn != NULL && t->realloc_fn != NULL && t->free_fn != NULL
+            && t->usable_size_fn != NULL && t->posix_memalign_fn != NULL) return true;
+    }
+    fprintf(stderr, "%s was found, but not all of its functions\n", name);
+    dlclose(library);
+    return false;
+}
+
+
+/* workloads */
+
+static size_t uniform_size(unsigned* seed) {
+    return 1 + (size_t) rand_r(seed) % UNIFORM_MAX_SIZE;
+}
+
+static size_t power_law_size(unsigned* seed) {
+    double u = ((double) rand_r(seed) + 1) / ((double) RAND_MAX + 2);
+    double size = POWER_LAW_MIN_SIZE * pow(u, -1 / POWER_LAW_ALPHA);
+    return (size >= POWER_LAW_MAX_SIZE) ? POWER_LAW_MAX_SIZE : (size_t) size;
+}
+
+static void churn(target* t, run_result* result, size_t (*next_size)(unsigned*)) {
+    static slot slots[SLOTS];
+    unsigned seed = 42;
+    for(size_t call = 0; call < calls; call++) {
+        slot *s = &(slots[rand_r(&seed) % SLOTS]);
+        if(s->ptr == NULL) {
+            size_t size = next_size(&seed);
+            bool zeroed = rand_r(&seed) % 8 == 0;
+            uint64_t start = now_ns();
+            s->ptr = target_alloc(t, size, 0, zeroed);
+            record(result, OP_ALLOC, start, s->ptr == NULL);
+            if(s->ptr == NULL) continue;
+            s->size = size;
+            touch(s->ptr, 0, size);
+            continue;
+        }
+        int choice = rand_r(&seed) % 8;
+        if(choice < 2) {
+            size_t size = next_size(&seed);
+            uint64_t start = now_ns();
+            void* new_ptr = target_resize(t, s->ptr, s->size, size, 0);
+            record(result, OP_RESIZE, start, new_ptr == NULL);
+            if(new_ptr == NULL) continue;
+            if(size > s->size) touch(new_ptr, s->size, size);
+            s->ptr = new_ptr;
+            s->size = size;
+        } else if(choice == 2) {
+            uint64_t start = now_ns();
+            size_t size = target_get_size(t, s->ptr);
+            record(result, OP_GET_SIZE, start, size < s->size);
+        } else {
+            uint64_t start = now_ns();
+            bool freed = target_free(t, s->ptr, s->size);
+            record(result, OP_FREE, start, !freed);
+            s->ptr = NULL;
+        }
+    }
+    target_finish(t, slots, SLOTS, result);
+}
+
+static void run_uniform(target* t, const workload* w, run_result* result) {
+    (void) w;
+    churn(t, result, uniform_size);
+}
+
+static void run_power_law(target* t, const workload* w, run_result* result) {
+    (void) w;
+    churn(t, result, power_law_size);
+}
+
+typedef struct queue {
+    slot items[QUEUE_SLOTS];
+    _Atomic size_t head;  /* next item to be taken */
+    _Atomic size_t tail;  /* next item to be put */
+    size_t count;         /* items the producer puts in all */
+    target *t;
+    run_result *result;
+} queue;
+
+static void* produce(void* arg) {
+    queue *q = arg;
+    unsigned seed = 42;
+    for(size_t k = 0; k < q->count; k++) {
+        size_t size = power_law_size(&seed);
+        uint64_t start = now_ns();
+        void* ptr = target_alloc(q->t, size, 0, false);
+        record(q->result, OP_ALLOC, start, ptr == NULL);
+        if(ptr != NULL) touch(ptr, 0, size);
+        size_t tail = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+        while(tail - atomic_load_explicit(&(q->head), memory_order_acquire) == QUEUE_SLOTS) ;
+        q->items[tail % QUEUE_SLOTS] = (slot) { ptr, size };
+        atomic_store_explicit(&(q->tail), tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+static void* consume(void* arg) {
+    queue *q = arg;
+    for(size_t k = 0; k < q->count; k++) {
+        size_t head = atomic_load_explicit(&(q->head), memory_order_relaxed);
+        while(atomic_load_explicit(&(q->tail), memory_order_acquire) == head) ;
+        slot item = q->items[head % QUEUE_SLOTS];
+        atomic_store_explicit(&(q->head), head + 1, memory_order_release);
+        if(item.ptr == NULL) continue;
+        uint64_t start = now_ns();
+        size_t size = target_get_size(q->t, item.ptr);
+        record(q->result, OP_GET_SIZE, start, size < item.size);
+        start = now_ns();
+        bool freed = target_free(q->t, item.ptr, item.size);
+        record(q->result, OP_FREE, start, !freed);
+    }
+    return NULL;
+}
+
+/* the producer records only allocations and the consumer only the rest, so they never share a latency array */
+static void run_producer_consumer(target* t, const workload* w, run_result* result) {
+    (void) w;
+    static queue q;
+    q.head = 0;
+    q.tail = 0;
+    q.count = calls / 3;
+    q.t = t;
+    q.result = result;
+    pthread_t producer, consumer;
+    pthread_create(&consumer, NULL, consume, &q);
+    pthread_create(&producer, NULL, produce, &q);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    target_finish(t, NULL, 0, result);
+}
+
+static void run_replay(target* t, const workload* w, run_result* result) {
+    slot *slots = calloc(w->ids, sizeof(slot));
+    uint8_t *alignments = calloc(w->ids, 1);
+    if(slots == NULL || alignments == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for(size_t k = 0; k < w->op_count; k++) {
+        const trace_op *op = &(w->ops[k]);
+        slot *s = &(slots[op->id]);
+        if(op->kind == 'a') {
+            if(s->ptr != NULL) continue;
+            uint64_t start = now_ns();
+            s->ptr = target_alloc(t, op->size, op->alignment_bits, op->zeroed);
+            record(result, OP_ALLOC, start, s->ptr == NULL);
+            if(s->ptr == NULL) continue;
+            s->size = op->size;
+            alignments[op->id] = op->alignment_bits;
+            touch(s->ptr, 0, op->size);
+        } else if(s->ptr == NULL) {
+            /* its allocation failed on this target */
+            continue;
+        } else if(op->kind == 'r') {
+            uint64_t start = now_ns();
+            void* new_ptr = target_resize(t, s->ptr, s->size, op->size, alignments[op->id]);
+            record(result, OP_RESIZE, start, new_ptr == NULL);
+            if(new_ptr == NULL) continue;
+            if(op->size > s->size) touch(new_ptr, s->size, op->size);
+            s->ptr = new_ptr;
+            s->size = op->size;
+        } else {
+            uint64_t start = now_ns();
+            bool freed = target_free(t, s->ptr, s->size);
+            record(result, OP_FREE, start, !freed);
+            s->ptr = NULL;
+        }
+    }
+    target_finish(t, slots, w->ids, result);
+    free(slots);
+    free(alignments);
+}
+
+static bool load_replay(const char* path, workload* out_workload) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "could not open %s\n", path);
+        return false;
+    }
+    const char* base = strrchr(path, '/');
+    snprintf(out_workload->name, sizeof(out_workload->name), "replay:%s", (base != NULL) ? base + 1 : path);
+    out_workload->run = run_replay;
+    out_workload->page_size = page_size;
+    out_workload->concurrent = false;
+    size_t capacity = 0;
+    char line[256];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        trace_op op = { 0 };
+        unsigned long long id, size = 0;
+        unsigned alignment_bits = 0, zeroed = 0, recorded_page_size;
+        if(sscanf(line, "# page_size %u", &recorded_page_size) == 1) {
+            out_workload->page_size = recorded_page_size;
+            continue;
+        }
+        if(sscanf(line, "%c %llu %llu %u %u", &(op.kind), &id, &size, &alignment_bits, &zeroed) < 2 || id >= UINT32_MAX
+            || (op.kind != 'a' && op.kind != 'r' && op.kind != 'f') || (op.kind != 'f' && size == 0)) continue;
+        op.id = (uint32_t) id;
+        op.size = (size_t) size;
+        op.alignment_bits = (uint8_t) alignment_bits;
+        op.zeroed = zeroed != 0;
+        if(out_workload->op_count == capacity) {
+            capacity = (capacity == 0) ? 4096 : capacity*2;
+            out_workload->ops = realloc(out_workload->ops, capacity*sizeof(trace_op));
+            if(out_workload->ops == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        out_workload->ops[out_workload->op_count++] = op;
+        if(op.id >= out_workload->ids) out_workload->ids = op.id + 1;
+    }
+    fclose(file);
+    return true;
+}
+
+
+/* measuring and reporting */
+
+/* a field of /proc/self/status in KiB, -1 if it can't be read */
+static long status_kib(const char* field) {
+    FILE *status = fopen("/proc/self/status", "r");
+    if(status == NULL) return -1;
+    char line[256];
+    long kib = -1;
+    size_t length = strlen(field);
+    while(fgets(line, sizeof(line), status) != NULL) {
+        if(strncmp(line, field, length) == 0 && line[length] == ':') {
+            kib = strtol(&(line[length + 1]), NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kib;
+}
+
+/* sets VmHWM back to the current resident memory */
+static bool reset_peak_rss(void) {
+    FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+    if(clear_refs == NULL) return false;
+    bool reset = fputs("5", clear_refs) >= 0;
+    return (fclose(clear_refs) == 0) && reset;
+}
+
+static int compare_durations(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const latencies* l, double fraction) {
+    return (l->count == 0) ? 0 : l->durations[(size_t) (fraction * (double) (l->count - 1))];
+}
+
+static bool run_workload(target* t, const workload* w, run_result* result) {
+    static bool warned;
+    size_t capacity = (w->run == run_replay) ? w->op_count : calls;
+    uint32_t *durations = malloc(OPS * (capacity + 1) * sizeof(uint32_t));
+    if(durations == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    /* the latency arrays are resident before the peak is reset, so they don't count */
+    memset(durations, 0, OPS * (capacity + 1) * sizeof(uint32_t));
+    memset(result, 0, sizeof(run_result));
+    result->capacity = capacity;
+    for(int op = 0; op < OPS; op++) result->ops[op].durations = &(durations[op * (capacity + 1)]);
+
+    if(!reset_peak_rss() && !warned) {
+        fprintf(stderr, "could not reset the peak resident memory, it accumulates over the runs\n");
+        warned = true;
+    }
+    long rss_before = status_kib("VmRSS");
+    if(!target_start(t, w)) {
+        free(durations);
+        return false;
+    }
+    uint64_t start = now_ns();
+    w->run(t, w, result);
+    result->seconds = (double) (now_ns() - start) / 1e9;
+    long peak = status_kib("VmHWM");
+    result->peak_rss_kib = (peak < 0 || rss_before < 0) ? -1 : peak - rss_before;
+    for(int op = 0; op < OPS; op++) qsort(result->ops[op].durations, result->ops[op].count, sizeof(uint32_t), compare_durations);
+    return true;
+}
+
+static void print_csv(const target* t, const workload* w, const run_result* result) {
+    size_t total = 0;
+    for(int op = 0; op < OPS; op++) total += result->ops[op].count;
+    for(int op = 0; op < OPS; op++) {
+        const latencies *l = &(result->ops[op]);
+        if(l->count == 0) continue;
+        printf("%s,%s,%s,%zu,%zu,%u,%u,%u,%u,%.0f,%ld,%zu,%zu,", t->name, w->name, op_names[op], l->count, l->failed,
+            percentile(l, 0.5), percentile(l, 0.99), percentile(l, 0.999), l->durations[l->count - 1],
+            (double) total / result->seconds, result->peak_rss_kib, result->live_bytes, result->usable_bytes);
+        if(result->free_run_fragmentation >= 0) printf("%.4f", result->free_run_fragmentation);
+        printf("\n");
+    }
+}
+
+static void print_json(const target* t, const workload* w, const run_result* result, bool first) {
+    size_t total = 0;
+    for(int op = 0; op < OPS; op++) total += result->ops[op].count;
+    printf("%s\n  {\"backend\": \"%s\", \"workload\": \"%s\", \"calls_per_s\": %.0f, \"peak_rss_kib\": %ld, \"live_bytes\": %zu, \"usable_bytes\": %zu, ",
+        first ? "" : ",", t->name, w->name, (double) total / result->seconds, result->peak_rss_kib, result->live_bytes, result->usable_bytes);
+    if(result->free_run_fragmentation >= 0) printf("\"free_run_fragmentation\": %.4f, \"ops\": {", result->free_run_fragmentation);
+    else printf("\"free_run_fragmentation\": null, \"ops\": {");
+    bool first_op = true;
+    for(int op = 0; op < OPS; op++) {
+        const latencies *l = &(result->ops[op]);
+        if(l->count == 0) continue;
+        printf("%s\"%s\": {\"calls\": %zu, \"failed\": %zu, \"p50_ns\": %u, \"p99_ns\": %u, \"p999_ns\": %u, \"max_ns\": %u}",
+            first_op ? "" : ", ", op_names[op], l->count, l->failed, percentile(l, 0.5), percentile(l, 0.99), percentile(l, 0.999), l->durations[l->count - 1]);
+        first_op = false;
+    }
+    printf("}}");
+}
+
+
+/* comparing */
+
+typedef struct csv_row {
+    char key[256];  /* backend,workload,op */
+    double p99_ns;
+    double calls_per_s;
+    double peak_rss_kib;
+} csv_row;
+
+static csv_row* read_csv(const char* path, size_t* out_count) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "could not open %s\n", path);
+        exit(2);
+    }
+    csv_row *rows = NULL;
+    size_t count = 0, capacity = 0;
+    char line[1024];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char *fields[16];
+        int n = 0;
+        for(char *field = strtok(line, ",\n"); field != NULL && n < 16; field = strtok(NULL, ",\n")) fields[n++] = field;
+        if(n < 13 || strcmp(fields[0], "backend") == 0) continue;
+        if(count == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity*2;
+            rows = realloc(rows, capacity*sizeof(csv_row));
+            if(rows == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(2);
+            }
+        }
+        snprintf(rows[count].key, sizeof(rows[count].key), "%s,%s,%s", fields[0], fields[1], fields[2]);
+        rows[count].p99_ns = strtod(fields[6], NULL);
+        rows[count].calls_per_s = strtod(fields[9], NULL);
+        rows[count].peak_rss_kib = strtod(fields[10], NULL);
+        count++;
+    }
+    fclose(file);
+    out_count[0] = count;
+    return rows;
+}
+
+static bool regressed(const char* key, const char* measure, double old_value, double new_value, bool higher_is_worse, double percent) {
+    if(old_value <= 0) return false;
+    double change = (new_value - old_value) / old_value * 100;
+    if(higher_is_worse ? change <= percent : -change <= percent) return false;
+    printf("%s,%s,%.0f,%.0f,%+.1f\n", key, measure, old_value, new_value, change);
+    return true;
+}
+
+static int compare(const char* old_path, const char* new_path, double percent) {
+    size_t old_count, new_count;
+    csv_row *old_rows = read_csv(old_path, &old_count), *new_rows = read_csv(new_path, &new_count);
+    bool any = false;
+    printf("backend,workload,op,measure,old,new,change_percent\n");
+    for(size_t n = 0; n < new_count; n++) {
+        for(size_t o = 0; o < old_count; o++) {
+            if(strcmp(old_rows[o].key, new_rows[n].key) != 0) continue;
+            any |= regressed(new_rows[n].key, "p99_ns", old_rows[o].p99_ns, new_rows[n].p99_ns, true, percent);
+            any |= regressed(new_rows[n].key, "calls_per_s", old_rows[o].calls_per_s, new_rows[n].calls_per_s, false, percent);
+            any |= regressed(new_rows[n].key, "peak_rss_kib", old_rows[o].peak_rss_kib, new_rows[n].peak_rss_kib, true, percent);
+            break;
+        }
+    }
+    free(old_rows);
+    free(new_rows);
+    return any ? 1 : 0;
+}
+
+
+int main(int argc, char** argv) {
+    bool json = false;
+    int first_replay = 1;
+    while(first_replay < argc && argv[first_replay][0] == '-') {
+        const char* option = argv[first_replay];
+        if(strcmp(option, "-c") == 0) {
+            if(first_replay + 2 >= argc) break;
+            return compare(argv[first_replay + 1], argv[first_replay + 2], (first_replay + 3 < argc) ? atof(argv[first_replay + 3]) : 10);
+        }
+        if(first_replay + 1 >= argc) break;
+        const char* value = argv[first_replay + 1];
+        if(strcmp(option, "-f") == 0) json = strcmp(value, "json") == 0;
+        else if(strcmp(option, "-n") == 0) calls = strtoull(value, NULL, 10);
+        else if(strcmp(option, "-p") == 0) page_size = (uint32_t) strtoul(value, NULL, 10);
+        else if(strcmp(option, "-m") == 0) heap_mib = strtoull(value, NULL, 10);
+        else break;
+        first_replay += 2;
+    }
+    if(first_replay < argc && argv[first_replay][0] == '-') {
+        fprintf(stderr, "usage: %s [-f csv|json] [-n calls] [-p page_size] [-m heap_mib] [<replay> ...]\n"
+                        "       %s -c <old.csv> <new.csv> [percent]\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    size_t workload_count = 3 + (size_t) (argc - first_replay);
+    workload *workloads = calloc(workload_count, sizeof(workload));
+    if(workloads == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    workloads[0] = (workload) { "uniform", run_uniform, page_size, false, NULL, 0, 0 };
+    workloads[1] = (workload) { "power_law", run_power_law, page_size, false, NULL, 0, 0 };
+    workloads[2] = (workload) { "producer_consumer", run_producer_consumer, page_size, true, NULL, 0, 0 };
+    size_t loaded = 3;
+    for(int k = first_replay; k < argc; k++) {
+        if(load_replay(argv[k], &(workloads[loaded]))) loaded++;
+    }
+
+    target targets[4];
+    int target_count = 0;
+    memset(&(targets[0]), 0, sizeof(target));
+    targets[0].name = "palloc";
+    targets[0].paged = true;
+    glibc_target(&(targets[1]));
+    target_count = 2;
+    static const char* const jemalloc_files[] = { "libjemalloc.so.2", "libjemalloc.so", NULL };
+    static const char* const jemalloc_prefixes[] = { "je_", "", NULL };
+    static const char* const mimalloc_files[] = { "libmimalloc.so.2", "libmimalloc.so", NULL };
+    static const char* const mimalloc_prefixes[] = { "mi_", NULL };
+    if(library_target(&(targets[target_count]), "jemalloc", jemalloc_files, jemalloc_prefixes, "malloc_usable_size")) target_count++;
+    else fprintf(stderr, "jemalloc not found, skipped\n");
+    if(library_target(&(targets[target_count]), "mimalloc", mimalloc_files, mimalloc_prefixes, "usable_size")) target_count++;
+    else fprintf(stderr, "mimalloc not found, skipped\n");
+
+    if(json) printf("[");
+    else printf("backend,workload,op,calls,failed,p50_ns,p99_ns,p999_ns,max_ns,calls_per_s,peak_rss_kib,live_bytes,usable_bytes,free_run_fragmentation\n");
+    fflush(stdout);
+    bool first = true;
+    for(size_t k = 0; k < loaded; k++) {
+        for(int t = 0; t < target_count; t++) {
+            /* every run gets a process of its own, so no heap starts with what an earlier run left behind */
+            pid_t child = fork();
+            if(child == 0) {
+                run_result result;
+                if(!run_workload(&(targets[t]), &(workloads[k]), &result)) _exit(1);
+                if(json) print_json(&(targets[t]), &(workloads[k]), &result, first);
+                else print_csv(&(targets[t]), &(workloads[k]), &result);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status;
+            if(child < 0 || waitpid(child, &status, 0) != child) {
+                fprintf(stderr, "could not run %s on %s\n", workloads[k].name, targets[t].name);
+                continue;
+            }
+            if(WIFEXITED(status) && WEXITSTATUS(status) == 0) first = false;
+            else fprintf(stderr, "%s on %s failed\n", workloads[k].name, targets[t].name);
+        }
+        free(workloads[k].ops);
+    }
+    if(json) printf("\n]\n");
+    free(workloads);
+    return 0;
+}
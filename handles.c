@@ -0,0 +1,255 @@
+/* for clock_gettime when compiling with a strict -std= */
+#define _DEFAULT_SOURCE
+
+#include "handles.h"
+#include "alloc_clock.h"
+#include "pat_kernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HANDLE_INITIAL_ENTRIES 64
+
+typedef struct handle_entry {
+    uint32_t first_page;  /* where the allocation starts, so it survives the backing data moving */
+    uint32_t pins;
+    uint32_t generation;
+    uint32_t next_free;   /* next unused entry while this one is unused, UINT32_MAX at the end of the list */
+    bool live;
+    size_t size;
+} handle_entry;
+
+static inline void* entry_address(const handle_table* p_table, const handle_entry *entry) {
+    return &(p_table->backing[0].data[(size_t) entry->first_page*p_table->backing[0].page_size]);
+}
+
+/* the entry of a live handle, or NULL for 0, stale and made-up handles */
+static handle_entry* live_entry(const handle_table* p_table, alloc_handle handle) {
+    uint32_t index = (uint32_t) handle;
+    if(index == 0 || index > p_table->capacity) return NULL;
+    handle_entry *entry = &(p_table->entries[index - 1]);
+    if(!entry->live || entry->generation != (uint32_t) (handle >> 32)) return NULL;
+    return entry;
+}
+
+static alloc_result grow_entries(handle_table* p_table) {
+    uint32_t new_capacity = (p_table->capacity == 0) ? HANDLE_INITIAL_ENTRIES : p_table->capacity*2;
+    if(p_table->capacity > UINT32_MAX / 4) {
+        if(p_table->log_function != NULL) p_table->log_function(ALLOCATION_ERROR, "The handle table is full");
+        return OUT_OF_MEMORY;
+    }
+    handle_entry *new_entries = realloc(p_table->entries, (size_t) new_capacity*sizeof(handle_entry));
+    if(new_entries == NULL) {
+        if(p_table->log_function != NULL) p_table->log_function(ALLOCATION_ERROR, "Ran out of system memory when trying to expand the handle table");
+        return OUT_OF_MEMORY;
+    }
+    /* the new entries go on the free list in ascending order */
+    for(uint32_t k = p_table->capacity; k < new_capacity; k++) {
+        new_entries[k].generation = 0;
+        new_entries[k].pins = 0;
+        new_entries[k].live = false;
+        new_entries[k].next_free = (k + 1 < new_capacity) ? k + 1 : p_table->free_entry;
+    }
+    p_table->free_entry = p_table->capacity;
+    p_table->entries = new_entries;
+    p_table->capacity = new_capacity;
+    return SUCCESS;
+}
+
+/* the backing allocator may have grown since the map was last sized */
+static alloc_result fit_page_map(handle_table* p_table) {
+    uint32_t backing_pages = p_table->backing[0].allocated_pages;
+    if(backing_pages <= p_table->map_pages) return SUCCESS;
+    uint32_t *new_map = realloc(p_table->page_entry, (size_t) backing_pages*sizeof(uint32_t));
+    if(new_map == NULL) {
+        if(p_table->log_function != NULL) p_table->log_function(ALLOCATION_ERROR, "Ran out of system memory when trying to expand the handle page map");
+        return OUT_OF_MEMORY;
+    }
+    memset(&(new_map[p_table->map_pages]), 0, (size_t) (backing_pages - p_table->map_pages)*sizeof(uint32_t));
+    p_table->page_entry = new_map;
+    p_table->map_pages = backing_pages;
+    return SUCCESS;
+}
+
+alloc_result init_handle_table(allocator* backing, PFN_alloc_log log_function, handle_table* out_table) {
+    if(out_table == NULL || backing == NULL) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Out-parameter for handle table struct or backing allocator is NULL!");
+        return INVALID_PARAMETER;
+    }
+    memset(out_table, 0, sizeof(handle_table));
+    out_table->backing = backing;
+    out_table->free_entry = UINT32_MAX;
+    out_table->log_function = log_function;
+    if(log_function != NULL) log_function(INITIALIZATION_SUCCESS, "Successfully initialized the handle table");
+    return SUCCESS;
+}
+
+alloc_result deinit_handle_table(handle_table* p_table) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    PFN_alloc_log log_function = p_table->log_function;
+
+    alloc_result result = SUCCESS;
+    for(uint32_t k = 0; k < p_table->capacity; k++) {
+        handle_entry *entry = &(p_table->entries[k]);
+        if(!entry->live) continue;
+        if(free_size(p_table->backing, entry_address(p_table, entry), entry->size) != SUCCESS) result = ERROR_UNKNOWN;
+    }
+    free(p_table->entries);
+    free(p_table->page_entry);
+    memset(p_table, 0, sizeof(handle_table));
+
+    if(log_function != NULL) log_function(result == SUCCESS ? DEINITIALIZATION_SUCCESS : DEINITIALIZATION_ERROR, "Deinitialized the handle table");
+    return result;
+}
+
+alloc_result handle_alloc(handle_table* p_table, size_t size, bool zeroed, alloc_handle* out_handle) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(out_handle == NULL) {
+        if(p_table->log_function != NULL) p_table->log_function(ALLOCATION_ERROR, "Out-pointer to store the handle is NULL!");
+        return INVALID_PARAMETER;
+    }
+    if(p_table->free_entry == UINT32_MAX) {
+        alloc_result grow_result = grow_entries(p_table);
+        if(grow_result != SUCCESS) return grow_result;
+    }
+
+    void* ptr;
+    alloc_result result = alloc_align_offset_zeroable(p_table->backing, size, 0, 0, zeroed, &ptr);
+    if(result != SUCCESS) return result;
+    result = fit_page_map(p_table);
+    if(result != SUCCESS) {
+        free_size(p_table->backing, ptr, size);
+        return result;
+    }
+
+    uint32_t index = p_table->free_entry;
+    handle_entry *entry = &(p_table->entries[index]);
+    p_table->free_entry = entry->next_free;
+    entry->live = true;
+    entry->first_page = (uint32_t) (((uint8_t*) ptr - p_table->backing[0].data) / p_table->backing[0].page_size);
+    entry->pins = 0;
+    entry->size = size;
+    p_table->page_entry[entry->first_page] = index + 1;
+
+    out_handle[0] = ((uint64_t) entry->generation << 32) | (index + 1);
+    return SUCCESS;
+}
+
+alloc_result handle_free(handle_table* p_table, alloc_handle handle) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    handle_entry *entry = live_entry(p_table, handle);
+    if(entry == NULL) {
+        if(p_table->log_function != NULL) p_table->log_function(DEALLOCATION_ERROR, "Handle to be freed is stale or invalid!");
+        return INVALID_ADDRESS;
+    }
+    if(entry->pins != 0) {
+        if(p_table->log_function != NULL) p_table->log_function(DEALLOCATION_ERROR, "Handle to be freed is still pinned!");
+        return INVALID_PARAMETER;
+    }
+    alloc_result result = free_size(p_table->backing, entry_address(p_table, entry), entry->size);
+    if(result != SUCCESS) return result;
+
+    uint32_t index = (uint32_t) handle - 1;
+    p_table->page_entry[entry->first_page] = 0;
+    entry->generation++;
+    entry->live = false;
+    entry->next_free = p_table->free_entry;
+    p_table->free_entry = index;
+    return SUCCESS;
+}
+
+alloc_result handle_get_size(const handle_table* p_table, alloc_handle handle, size_t* size) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    handle_entry *entry = live_entry(p_table, handle);
+    if(entry == NULL || size == NULL) {
+        if(p_table->log_function != NULL) p_table->log_function(SIZE_ERROR, "Handle is stale or invalid, or the out-pointer to store size is NULL!");
+        return (entry == NULL) ? INVALID_ADDRESS : INVALID_PARAMETER;
+    }
+    size[0] = entry->size;
+    return SUCCESS;
+}
+
+alloc_result handle_pin(handle_table* p_table, alloc_handle handle, void** out_ptr) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    handle_entry *entry = live_entry(p_table, handle);
+    if(entry == NULL || out_ptr == NULL || entry->pins == UINT32_MAX) {
+        if(p_table->log_function != NULL) p_table->log_function(ALLOCATION_ERROR, "Handle to be pinned is stale or invalid, pinned too often, or the out-pointer is NULL!");
+        return (entry == NULL) ? INVALID_ADDRESS : INVALID_PARAMETER;
+    }
+    entry->pins++;
+    out_ptr[0] = entry_address(p_table, entry);
+    return SUCCESS;
+}
+
+alloc_result handle_unpin(handle_table* p_table, alloc_handle handle) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    handle_entry *entry = live_entry(p_table, handle);
+    if(entry == NULL || entry->pins == 0) {
+        if(p_table->log_function != NULL) p_table->log_function(DEALLOCATION_ERROR, "Handle to be unpinned is stale or invalid, or isn't pinned!");
+        return (entry == NULL) ? INVALID_ADDRESS : INVALID_PARAMETER;
+    }
+    entry->pins--;
+    return SUCCESS;
+}
+
+alloc_result compact_handles(handle_table* p_table, uint64_t budget_ns, size_t* out_moved_bytes, bool* out_pass_done) {
+    if(p_table == NULL) {
+        return INVALID_PARAMETER;
+    }
+    const allocator *backing = p_table->backing;
+    uint64_t start = monotonic_ns();
+    size_t moved_bytes = 0;
+    bool pass_done = false;
+
+    /* only an allocation right after free pages can move, and the first page after a free run always starts one */
+    uint32_t cursor = p_table->compact_cursor;
+    for(bool first = true; ; first = false) {
+        /* checked before every step, skipped ones included, but after at least one so that a pass always ends */
+        if(!first && monotonic_ns() - start >= budget_ns) break;
+        uint32_t pages = backing[0].allocated_pages;
+        uint32_t gap = (uint32_t) pat_find_page(backing[0].PAT, cursor, pages, PAT_FREE);
+        uint32_t i = (gap < pages) ? gap + (uint32_t) pat_extend_run(backing[0].PAT, gap, pages, PAT_FREE) : pages;
+        if(i >= pages) {
+            pass_done = true;
+            cursor = 0;
+            break;
+        }
+
+        uint32_t index = (i < p_table->map_pages) ? p_table->page_entry[i] : 0;
+        handle_entry *entry = (index != 0) ? &(p_table->entries[index - 1]) : NULL;
+        if(entry == NULL || entry->pins != 0) {
+            cursor = i + backing[0].run_pages[i];
+            continue;
+        }
+
+        void* new_ptr;
+        alloc_result result = relocate_lower(backing, entry_address(p_table, entry), &new_ptr);
+        if(result != SUCCESS) {
+            p_table->compact_cursor = cursor;
+            return result;
+        }
+        uint32_t new_page = (uint32_t) (((uint8_t*) new_ptr - backing[0].data) / backing[0].page_size);
+        p_table->page_entry[i] = 0;
+        p_table->page_entry[new_page] = index;
+        entry->first_page = new_page;
+        moved_bytes += (size_t) backing[0].run_pages[new_page]*backing[0].page_size;
+        cursor = new_page + backing[0].run_pages[new_page];
+    }
+    p_table->compact_cursor = cursor;
+
+    if(out_moved_bytes != NULL) out_moved_bytes[0] = moved_bytes;
+    if(out_pass_done != NULL) out_pass_done[0] = pass_done;
+    return SUCCESS;
+}
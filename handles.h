@@ -0,0 +1,57 @@
+#ifndef HANDLES_H
+#define HANDLES_H
+
+#include "alloc.h"
+
+/* Movable allocations behind indirect handles, on top of an existing allocator.
+
+   Callers hold an alloc_handle instead of a pointer and pin it to get at the memory; the pointer
+   stays valid until the matching unpin. Allocations of unpinned handles may be moved by
+   compact_handles, which walks the pages of the backing allocator from where the last call stopped
+   and slides every unpinned allocation that sits after a free gap down to the lowest place that
+   holds it (see relocate_lower), so the free pages gather at the high end. It works in time slices:
+   each call checks its budget before every step, moves and skipped allocations alike, so the pauses
+   stay bounded.
+
+   Allocations made on the backing allocator directly are never moved, and the compactor skips them.
+   Like a plain allocator, a handle table must not be used from several threads at once, and while
+   compact_handles runs no other thread may use the backing allocator either.
+*/
+
+/* generation << 32 | (entry + 1); 0 is no handle, and a freed handle is stale once its entry is reused */
+typedef uint64_t alloc_handle;
+
+struct handle_entry;
+
+typedef struct handle_table {
+    allocator *backing;
+    struct handle_entry *entries;
+    uint32_t capacity;
+    uint32_t free_entry;      /* head of the list of unused entries, UINT32_MAX if there is none */
+    uint32_t *page_entry;     /* per backing page: entry + 1 of the handle whose allocation starts there, else 0 */
+    uint32_t map_pages;       /* pages covered by page_entry */
+    uint32_t compact_cursor;  /* page the next compaction slice continues from */
+    PFN_alloc_log log_function;
+} handle_table;
+
+
+alloc_result init_handle_table(allocator* backing, PFN_alloc_log log_function, handle_table* out_table);
+/* frees the allocations of all handles still alive */
+alloc_result deinit_handle_table(handle_table* p_table);
+
+alloc_result handle_alloc(handle_table* p_table, size_t size, bool zeroed, alloc_handle* out_handle);
+/* the handle must not be pinned */
+alloc_result handle_free(handle_table* p_table, alloc_handle handle);
+alloc_result handle_get_size(const handle_table* p_table, alloc_handle handle, size_t* size);
+
+/* pins nest: the allocation stays where out_ptr points until every pin has been matched by an unpin */
+alloc_result handle_pin(handle_table* p_table, alloc_handle handle, void** out_ptr);
+alloc_result handle_unpin(handle_table* p_table, alloc_handle handle);
+
+/* moves unpinned allocations down until budget_ns have passed (checked before every step but the first, which
+   moves or skips one allocation) or the end of the pages is reached, which sets out_pass_done and starts the next
+   call at the low end again; a pass that moved nothing leaves the handles as compact as they get. Either
+   out-pointer may be NULL */
+alloc_result compact_handles(handle_table* p_table, uint64_t budget_ns, size_t* out_moved_bytes, bool* out_pass_done);
+
+#endif
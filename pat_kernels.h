@@ -0,0 +1,372 @@
+#ifndef PAT_KERNELS_H
+#define PAT_KERNELS_H
+
+/* Scanning and marking kernels for the Page Allocation Table.
+
+   The PAT is stored little endian with 2 bits per page, so one 64 bit word holds 32 pages,
+   page j of the word in bits 2j (low) and 2j+1 (high). A page is free iff its high bit is
+   clear (00, 01), freed but not zeroed iff it is exactly 01, and a continuation iff both bits
+   are set (11). The word kernels compress a word into a dense 32 bit mask with one bit per page
+   and work on those masks with bit scans; with SSE2 or AVX2 available, long stretches that can't
+   contain a match are skipped 16 or 32 bytes (64 or 128 pages) at a time.
+
+   The _scalar variants walk page by page like the original loops did. They are the fallback
+   for compilers without the bit scan builtins and the reference for bench/bench_pat_kernels.c;
+   defining ALLOC_SCALAR_PAT builds the allocator with them.
+
+   All kernels expect the PAT to be padded to whole 64 bit words.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(ALLOC_SCALAR_PAT) && !defined(__GNUC__)
+#define ALLOC_SCALAR_PAT
+#endif
+
+#if !defined(ALLOC_SCALAR_PAT) && defined(__AVX2__)
+#include <immintrin.h>
+#elif !defined(ALLOC_SCALAR_PAT) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define PAT_PAGES_PER_WORD 32
+#define PAT_LOW_BITS  0x5555555555555555ULL
+#define PAT_HIGH_BITS 0xAAAAAAAAAAAAAAAAULL
+
+/* the page classes the kernels can search for */
+typedef enum pat_page_kind {
+    PAT_FREE,          /* 00 or 01 */
+    PAT_DIRTY,         /* 01 */
+    PAT_CONTINUATION   /* 11 */
+} pat_page_kind;
+
+
+static inline bool pat_page_is(const uint8_t *PAT, size_t i, pat_page_kind kind) {
+    int state = (PAT[i/4] >> (i%4)*2) & 0x3;
+    switch(kind) {
+        case PAT_FREE: return state < 0x02;
+        case PAT_DIRTY: return state == 0x01;
+        case PAT_CONTINUATION: return state == 0x03;
+    }
+    return false;
+}
+
+static inline uint64_t pat_load_word(const uint8_t *PAT, size_t word) {
+    uint64_t value;
+    memcpy(&value, &(PAT[word*8]), sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline void pat_store_word(uint8_t *PAT, size_t word, uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    memcpy(&(PAT[word*8]), &value, sizeof(uint64_t));
+}
+
+/* mask for the pages [first, last) of a word, with 0 <= first < last <= 32 */
+static inline uint64_t pat_page_mask(size_t first, size_t last) {
+    uint64_t upper = (last == PAT_PAGES_PER_WORD) ? ~0ULL : ((1ULL << 2*last) - 1);
+    return upper & ~((1ULL << 2*first) - 1);
+}
+
+
+/* ---- scalar kernels ---- */
+
+static inline size_t pat_find_page_scalar(const uint8_t *PAT, size_t from, size_t last, pat_page_kind kind) {
+    size_t i = from;
+    while(i < last && !pat_page_is(PAT, i, kind)) i++;
+    return i;
+}
+
+static inline size_t pat_extend_run_scalar(const uint8_t *PAT, size_t from, size_t last, pat_page_kind kind) {
+    size_t i = from;
+    while(i < last && pat_page_is(PAT, i, kind)) i++;
+    return i - from;
+}
+
+/* number of free pages directly before page i, i.e. how far the free run ending at i reaches back */
+static inline size_t pat_free_run_before_scalar(const uint8_t *PAT, size_t i) {
+    size_t j = i;
+    while(j > 0 && pat_page_is(PAT, j - 1, PAT_FREE)) j--;
+    return i - j;
+}
+
+static inline bool pat_find_free_run_scalar(const uint8_t *PAT, size_t from, size_t last, size_t pages, size_t *out_start) {
+    size_t length_found = 0;
+    for(size_t i = from; i < last; i++) {
+        if(pat_page_is(PAT, i, PAT_FREE)) {
+            length_found++;
+            if(length_found == pages) {
+                out_start[0] = i + 1 - pages;
+                return true;
+            }
+        } else {
+            length_found = 0;
+        }
+    }
+    return false;
+}
+
+static inline void pat_set_range_scalar(uint8_t *PAT, size_t first, size_t last, int new_state) {
+    for(size_t i = first; i < last; i++) {
+        int old_value = PAT[i/4];
+        int new_value = new_state << (i%4)*2;
+        int write_mask = (0x3 << (i%4)*2);
+        int old_mask = 0xFF - write_mask;
+        PAT[i/4] = (old_value&old_mask) | new_value;
+    }
+}
+
+static inline void pat_summarize_word_scalar(const uint8_t *PAT, size_t word, uint32_t *prefix, uint32_t *suffix, uint32_t *longest) {
+    uint32_t current = 0;
+    bool in_prefix = true;
+    prefix[0] = 0;
+    longest[0] = 0;
+    for(size_t i = word*PAT_PAGES_PER_WORD; i < (word+1)*PAT_PAGES_PER_WORD; i++) {
+        if(pat_page_is(PAT, i, PAT_FREE)) {
+            current++;
+            if(current > longest[0]) longest[0] = current;
+        } else {
+            in_prefix = false;
+            current = 0;
+        }
+        if(in_prefix) prefix[0] = current;
+    }
+    suffix[0] = current;
+}
+
+
+/* ---- word kernels ---- */
+
+#ifndef ALLOC_SCALAR_PAT
+
+/* gathers the bits at even positions into the low 32 bits */
+static inline uint32_t pat_compress_bits(uint64_t spread) {
+    spread = (spread | (spread >> 1)) & 0x3333333333333333ULL;
+    spread = (spread | (spread >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    spread = (spread | (spread >> 4)) & 0x00FF00FF00FF00FFULL;
+    spread = (spread | (spread >> 8)) & 0x0000FFFF0000FFFFULL;
+    spread = (spread | (spread >> 16)) & 0x00000000FFFFFFFFULL;
+    return (uint32_t) spread;
+}
+
+static inline uint32_t pat_kind_bits(uint64_t word, pat_page_kind kind) {
+    switch(kind) {
+        case PAT_FREE: return pat_compress_bits(~(word >> 1) & PAT_LOW_BITS);
+        case PAT_DIRTY: return pat_compress_bits(word & ~(word >> 1) & PAT_LOW_BITS);
+        case PAT_CONTINUATION: return pat_compress_bits(word & (word >> 1) & PAT_LOW_BITS);
+    }
+    return 0;
+}
+
+/* skips whole words in [word, end_word) that contain no free page */
+static inline size_t pat_skip_used_words(const uint8_t *PAT, size_t word, size_t end_word) {
+#if defined(__AVX2__)
+    const __m256i high_bits = _mm256_set1_epi8((char) 0xAA);
+    while(word + 4 <= end_word) {
+        __m256i value = _mm256_loadu_si256((const __m256i*) &(PAT[word*8]));
+        __m256i used = _mm256_cmpeq_epi8(_mm256_and_si256(value, high_bits), high_bits);
+        if((uint32_t) _mm256_movemask_epi8(used) != 0xFFFFFFFFu) break;
+        word += 4;
+    }
+#elif defined(__SSE2__)
+    const __m128i high_bits = _mm_set1_epi8((char) 0xAA);
+    while(word + 2 <= end_word) {
+        __m128i value = _mm_loadu_si128((const __m128i*) &(PAT[word*8]));
+        __m128i used = _mm_cmpeq_epi8(_mm_and_si128(value, high_bits), high_bits);
+        if(_mm_movemask_epi8(used) != 0xFFFF) break;
+        word += 2;
+    }
+#endif
+    while(word < end_word && (pat_load_word(PAT, word) & PAT_HIGH_BITS) == PAT_HIGH_BITS) word++;
+    return word;
+}
+
+/* skips whole words in [word, end_word) that consist of continuations only */
+static inline size_t pat_skip_continuation_words(const uint8_t *PAT, size_t word, size_t end_word) {
+#if defined(__AVX2__)
+    const __m256i all_ones = _mm256_set1_epi8((char) 0xFF);
+    while(word + 4 <= end_word) {
+        __m256i value = _mm256_loadu_si256((const __m256i*) &(PAT[word*8]));
+        if((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(value, all_ones)) != 0xFFFFFFFFu) break;
+        word += 4;
+    }
+#elif defined(__SSE2__)
+    const __m128i all_ones = _mm_set1_epi8((char) 0xFF);
+    while(word + 2 <= end_word) {
+        __m128i value = _mm_loadu_si128((const __m128i*) &(PAT[word*8]));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(value, all_ones)) != 0xFFFF) break;
+        word += 2;
+    }
+#endif
+    while(word < end_word && pat_load_word(PAT, word) == ~0ULL) word++;
+    return word;
+}
+
+/* kind bits of the pages [i, i+available) in the low bits, where available is clipped to the word and to last */
+static inline uint32_t pat_window_bits(const uint8_t *PAT, size_t i, size_t last, pat_page_kind kind, size_t *available) {
+    size_t shift = i % PAT_PAGES_PER_WORD;
+    size_t count = PAT_PAGES_PER_WORD - shift;
+    if(last - i < count) count = last - i;
+    uint32_t bits = pat_kind_bits(pat_load_word(PAT, i / PAT_PAGES_PER_WORD), kind) >> shift;
+    if(count < PAT_PAGES_PER_WORD) bits &= (1u << count) - 1;
+    available[0] = count;
+    return bits;
+}
+
+static inline size_t pat_find_page_words(const uint8_t *PAT, size_t from, size_t last, pat_page_kind kind) {
+    size_t i = from;
+    while(i < last) {
+        if(kind == PAT_FREE && i % PAT_PAGES_PER_WORD == 0) {
+            i = pat_skip_used_words(PAT, i / PAT_PAGES_PER_WORD, last / PAT_PAGES_PER_WORD) * PAT_PAGES_PER_WORD;
+            if(i >= last) return last;
+        }
+        size_t available;
+        uint32_t bits = pat_window_bits(PAT, i, last, kind, &available);
+        if(bits != 0) return i + __builtin_ctz(bits);
+        i += available;
+    }
+    return last;
+}
+
+static inline size_t pat_extend_run_words(const uint8_t *PAT, size_t from, size_t last, pat_page_kind kind) {
+    size_t i = from;
+    while(i < last) {
+        if(kind == PAT_CONTINUATION && i % PAT_PAGES_PER_WORD == 0) {
+            i = pat_skip_continuation_words(PAT, i / PAT_PAGES_PER_WORD, last / PAT_PAGES_PER_WORD) * PAT_PAGES_PER_WORD;
+            if(i >= last) return last - from;
+        }
+        size_t available;
+        uint32_t bits = pat_window_bits(PAT, i, last, kind, &available);
+        uint32_t full = (available == PAT_PAGES_PER_WORD) ? ~0u : ((1u << available) - 1);
+        if(bits != full) return i + __builtin_ctz(~bits) - from;
+        i += available;
+    }
+    return last - from;
+}
+
+static inline size_t pat_free_run_before_words(const uint8_t *PAT, size_t i) {
+    size_t count = 0;
+    while(i > 0) {
+        size_t word = (i - 1) / PAT_PAGES_PER_WORD;
+        size_t available = i - word*PAT_PAGES_PER_WORD;
+        /* page i-1 goes to the top bit, the pages from i on are shifted out and zeros shifted in below */
+        uint32_t bits = pat_kind_bits(pat_load_word(PAT, word), PAT_FREE);
+        if(available < PAT_PAGES_PER_WORD) bits <<= PAT_PAGES_PER_WORD - available;
+        size_t run = (bits == ~0u) ? PAT_PAGES_PER_WORD : (size_t) __builtin_clz(~bits);
+        if(run < available) return count + run;
+        count += available;
+        i -= available;
+    }
+    return count;
+}
+
+static inline bool pat_find_free_run_words(const uint8_t *PAT, size_t from, size_t last, size_t pages, size_t *out_start) {
+    size_t run = 0;
+    size_t i = from;
+    while(i < last) {
+        if(run == 0 && i % PAT_PAGES_PER_WORD == 0) {
+            i = pat_skip_used_words(PAT, i / PAT_PAGES_PER_WORD, last / PAT_PAGES_PER_WORD) * PAT_PAGES_PER_WORD;
+            if(i >= last) return false;
+        }
+        size_t available;
+        uint32_t bits = pat_window_bits(PAT, i, last, PAT_FREE, &available);
+        uint32_t full = (available == PAT_PAGES_PER_WORD) ? ~0u : ((1u << available) - 1);
+        if(bits == full) {
+            if(run + available >= pages) {
+                out_start[0] = i - run;
+                return true;
+            }
+            run += available;
+            i += available;
+            continue;
+        }
+        /* the run carried over from the previous words ends at the first used page of this one */
+        size_t position = __builtin_ctz(~bits);
+        if(run + position >= pages) {
+            out_start[0] = i - run;
+            return true;
+        }
+        run = 0;
+        while(position < available) {
+            uint32_t rest = bits >> position;
+            if(rest == 0) break;
+            position += __builtin_ctz(rest);
+            rest = bits >> position;
+            size_t length = __builtin_ctz(~rest);
+            if(length >= pages) {
+                out_start[0] = i + position;
+                return true;
+            }
+            if(position + length == available) {
+                run = length;
+                break;
+            }
+            position += length;
+        }
+        i += available;
+    }
+    return false;
+}
+
+static inline void pat_set_range_words(uint8_t *PAT, size_t first, size_t last, int new_state) {
+    if(first >= last) return;
+    uint64_t pattern = (uint64_t) new_state * PAT_LOW_BITS;
+    size_t first_word = first / PAT_PAGES_PER_WORD;
+    size_t last_word = (last - 1) / PAT_PAGES_PER_WORD;
+    if(first_word == last_word) {
+        uint64_t mask = pat_page_mask(first % PAT_PAGES_PER_WORD, last - last_word*PAT_PAGES_PER_WORD);
+        pat_store_word(PAT, first_word, (pat_load_word(PAT, first_word) & ~mask) | (pattern & mask));
+        return;
+    }
+    uint64_t head_mask = pat_page_mask(first % PAT_PAGES_PER_WORD, PAT_PAGES_PER_WORD);
+    pat_store_word(PAT, first_word, (pat_load_word(PAT, first_word) & ~head_mask) | (pattern & head_mask));
+    /* whole words in between are a plain byte fill, which memset already does vectorized */
+    memset(&(PAT[(first_word+1)*8]), new_state * 0x55, (last_word - first_word - 1)*8);
+    uint64_t tail_mask = pat_page_mask(0, last - last_word*PAT_PAGES_PER_WORD);
+    pat_store_word(PAT, last_word, (pat_load_word(PAT, last_word) & ~tail_mask) | (pattern & tail_mask));
+}
+
+static inline void pat_summarize_word_words(const uint8_t *PAT, size_t word, uint32_t *prefix, uint32_t *suffix, uint32_t *longest) {
+    uint32_t bits = pat_kind_bits(pat_load_word(PAT, word), PAT_FREE);
+    if(bits == ~0u) {
+        prefix[0] = suffix[0] = longest[0] = PAT_PAGES_PER_WORD;
+        return;
+    }
+    prefix[0] = __builtin_ctz(~bits);
+    suffix[0] = __builtin_clz(~bits);
+    longest[0] = 0;
+    while(bits != 0) {
+        bits >>= __builtin_ctz(bits);
+        uint32_t length = (bits == ~0u) ? PAT_PAGES_PER_WORD : (uint32_t) __builtin_ctz(~bits);
+        if(length > longest[0]) longest[0] = length;
+        bits = (length == PAT_PAGES_PER_WORD) ? 0 : (bits >> length);
+    }
+}
+
+#define pat_find_page pat_find_page_words
+#define pat_extend_run pat_extend_run_words
+#define pat_free_run_before pat_free_run_before_words
+#define pat_find_free_run pat_find_free_run_words
+#define pat_set_range pat_set_range_words
+#define pat_summarize_word pat_summarize_word_words
+
+#else
+
+#define pat_find_page pat_find_page_scalar
+#define pat_extend_run pat_extend_run_scalar
+#define pat_free_run_before pat_free_run_before_scalar
+#define pat_find_free_run pat_find_free_run_scalar
+#define pat_set_range pat_set_range_scalar
+#define pat_summarize_word pat_summarize_word_scalar
+
+#endif
+
+#endif
@@ -0,0 +1,321 @@
+#include "slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct slab_header {
+    uint32_t slot_size;       /* first, so a slab can be recognized as such from its start */
+    uint32_t size_class;
+    uint32_t used_slots;
+    uint32_t touched_slots;   /* slots [0, touched_slots) have been handed out before, the rest never were */
+    void *free_list;          /* freed slots, each holding the pointer to the next one */
+    struct slab_header *prev;
+    struct slab_header *next;
+    /* followed by the bitmap of slots in use */
+} slab_header;
+
+static const uint32_t slab_slot_sizes[SLAB_MAX_CLASSES] = { 8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048 };
+
+static inline uint64_t* slot_bitmap(slab_header *slab) {
+    return (uint64_t*) (slab + 1);
+}
+
+static inline uint8_t* slot_address(const slab_allocator* p_slab, slab_header *slab, uint32_t slot) {
+    return ((uint8_t*) slab) + p_slab->first_slot_offset[slab->size_class] + (size_t) slot*slab->slot_size;
+}
+
+/* slots are aligned to the largest power of two dividing their size, up to the 64 byte alignment of the first slot */
+static bool slot_alignment_fits(uint32_t slot_size, int alignment_bits, size_t offset_to_alignment) {
+    if(alignment_bits == 0) return true;
+    if(alignment_bits > 6) return false;
+    size_t alignment = (size_t) 1 << alignment_bits;
+    return (slot_size & (uint32_t) -slot_size) >= alignment && offset_to_alignment % alignment == 0;
+}
+
+/* the smallest class that holds size bytes with the asked-for alignment, or class_count if there is none */
+static uint32_t class_for_size(const slab_allocator* p_slab, size_t size, int alignment_bits, size_t offset_to_alignment) {
+    uint32_t k = 0;
+    while(k < p_slab->class_count && (p_slab->slot_sizes[k] < size || !slot_alignment_fits(p_slab->slot_sizes[k], alignment_bits, offset_to_alignment))) k++;
+    return k;
+}
+
+/* the slab that ptr lies in, or NULL if it isn't inside one */
+static slab_header* owning_slab(const slab_allocator* p_slab, const void* ptr) {
+    const allocator *backing = p_slab->backing;
+    uint8_t *slab_start = (uint8_t*) ((size_t) ptr & ~(p_slab->slab_bytes - 1));
+    if(slab_start < backing[0].data) return NULL;
+    size_t page = ((size_t) (slab_start - backing[0].data)) / backing[0].page_size;
+    if(page >= p_slab->map_pages) return NULL;
+    if(((p_slab->slab_map[page / 64] >> (page % 64)) & 1) == 0) return NULL;
+    return (slab_header*) slab_start;
+}
+
+static void set_slab_start(slab_allocator* p_slab, const void* slab, bool is_slab) {
+    size_t page = ((size_t) ((const uint8_t*) slab - p_slab->backing[0].data)) / p_slab->backing[0].page_size;
+    if(is_slab) p_slab->slab_map[page / 64] |= (uint64_t) 1 << (page % 64);
+    else p_slab->slab_map[page / 64] &= ~((uint64_t) 1 << (page % 64));
+}
+
+static void unlink_partial(slab_allocator* p_slab, slab_header *slab) {
+    if(slab->prev != NULL) slab->prev->next = slab->next;
+    else p_slab->partial[slab->size_class] = slab->next;
+    if(slab->next != NULL) slab->next->prev = slab->prev;
+    slab->prev = slab->next = NULL;
+}
+
+static void link_partial(slab_allocator* p_slab, slab_header *slab) {
+    slab->prev = NULL;
+    slab->next = p_slab->partial[slab->size_class];
+    if(slab->next != NULL) slab->next->prev = slab;
+    p_slab->partial[slab->size_class] = slab;
+}
+
+static alloc_result new_slab(slab_allocator* p_slab, uint32_t size_class, slab_header **out_slab) {
+    void* memory;
+    alloc_result result = alloc_align_offset_zeroable(p_slab->backing, p_slab->slab_bytes, p_slab->slab_bits, 0, false, &memory);
+    if(result != SUCCESS) return result;
+
+    /* the backing allocator may have grown since the map was last sized */
+    uint32_t backing_pages = p_slab->backing[0].allocated_pages;
+    if(backing_pages > p_slab->map_pages) {
+        size_t old_words = ((size_t) p_slab->map_pages + 63) / 64;
+        size_t new_words = ((size_t) backing_pages + 63) / 64;
+        uint64_t *new_map = realloc(p_slab->slab_map, new_words*sizeof(uint64_t));
+        if(new_map == NULL) {
+            free_size(p_slab->backing, memory, p_slab->slab_bytes);
+            if(p_slab->log_function != NULL) p_slab->log_function(ALLOCATION_ERROR, "Ran out of system memory when trying to expand the slab map");
+            return OUT_OF_MEMORY;
+        }
+        memset(&(new_map[old_words]), 0, (new_words - old_words)*sizeof(uint64_t));
+        p_slab->slab_map = new_map;
+        p_slab->map_pages = (uint32_t) (new_words*64 < UINT32_MAX ? new_words*64 : UINT32_MAX);
+    }
+
+    slab_header *slab = memory;
+    slab->slot_size = p_slab->slot_sizes[size_class];
+    slab->size_class = size_class;
+    slab->used_slots = 0;
+    slab->touched_slots = 0;
+    slab->free_list = NULL;
+    memset(slot_bitmap(slab), 0, ((p_slab->slots_per_slab[size_class] + 63) / 64)*sizeof(uint64_t));
+    set_slab_start(p_slab, slab, true);
+    link_partial(p_slab, slab);
+    p_slab->slab_count++;
+
+    out_slab[0] = slab;
+    return SUCCESS;
+}
+
+static alloc_result release_slab(slab_allocator* p_slab, slab_header *slab) {
+    unlink_partial(p_slab, slab);
+    set_slab_start(p_slab, slab, false);
+    p_slab->slab_count--;
+    return free_size(p_slab->backing, slab, p_slab->slab_bytes);
+}
+
+static alloc_result alloc_slot(slab_allocator* p_slab, uint32_t size_class, bool zeroed, void** out_ptr) {
+    slab_header *slab = p_slab->partial[size_class];
+    if(slab == NULL) {
+        alloc_result result = new_slab(p_slab, size_class, &slab);
+        if(result != SUCCESS) return result;
+    }
+
+    uint8_t *slot;
+    if(slab->free_list != NULL) {
+        slot = slab->free_list;
+        memcpy(&(slab->free_list), slot, sizeof(void*));
+    } else {
+        slot = slot_address(p_slab, slab, slab->touched_slots);
+        slab->touched_slots++;
+    }
+    uint32_t index = (uint32_t) ((size_t) (slot - slot_address(p_slab, slab, 0)) / slab->slot_size);
+    slot_bitmap(slab)[index / 64] |= (uint64_t) 1 << (index % 64);
+    slab->used_slots++;
+    if(slab->used_slots == p_slab->slots_per_slab[size_class]) unlink_partial(p_slab, slab);
+
+    if(zeroed) memset(slot, 0, slab->slot_size);
+    out_ptr[0] = slot;
+    return SUCCESS;
+}
+
+/* checks that ptr is the start of a slot in use of slab and returns its index */
+static alloc_result validate_slot(const slab_allocator* p_slab, slab_header *slab, void* ptr, size_t old_size, alloc_code error_code, uint32_t *out_index) {
+    size_t offset = (size_t) ((uint8_t*) ptr - slot_address(p_slab, slab, 0));
+    uint32_t index = (uint32_t) (offset / slab->slot_size);
+    if((uint8_t*) ptr < slot_address(p_slab, slab, 0) || offset % slab->slot_size != 0 || index >= slab->touched_slots
+        || ((slot_bitmap(slab)[index / 64] >> (index % 64)) & 1) == 0) {
+        if(p_slab->log_function != NULL) p_slab->log_function(error_code, "Pointer doesn't point to the begin of a slot in use!");
+        return INVALID_ADDRESS;
+    }
+    if(old_size != 0 && old_size != NO_OLD_SIZE_DATA && old_size > slab->slot_size) {
+        if(p_slab->log_function != NULL) p_slab->log_function(error_code, "Slot doesn't have the expected length!");
+        return INVALID_ADDRESS;
+    }
+    out_index[0] = index;
+    return SUCCESS;
+}
+
+static alloc_result free_slot(slab_allocator* p_slab, slab_header *slab, uint32_t index) {
+    uint8_t *slot = slot_address(p_slab, slab, index);
+    slot_bitmap(slab)[index / 64] &= ~((uint64_t) 1 << (index % 64));
+    memcpy(slot, &(slab->free_list), sizeof(void*));
+    slab->free_list = slot;
+    if(slab->used_slots == p_slab->slots_per_slab[slab->size_class]) link_partial(p_slab, slab);
+    slab->used_slots--;
+
+    /* an empty slab goes back to the backing allocator unless it is the last one with free slots of its class */
+    if(slab->used_slots == 0 && (slab->prev != NULL || slab->next != NULL)) return release_slab(p_slab, slab);
+    return SUCCESS;
+}
+
+
+alloc_result init_slab_allocator(allocator* backing, size_t slab_bytes, PFN_alloc_log log_function, slab_allocator* out_slab) {
+    if(out_slab == NULL || backing == NULL) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Out-parameter for slab allocator struct or backing allocator is NULL!");
+        return INVALID_PARAMETER;
+    }
+    if(slab_bytes == 0) slab_bytes = SLAB_DEFAULT_BYTES;
+    if(slab_bytes < 1024 || (slab_bytes & (slab_bytes - 1)) != 0 || slab_bytes < backing[0].page_size) {
+        if(log_function != NULL) log_function(INITIALIZATION_ERROR, "Slab size must be a power of two of at least 1 KiB and a page!");
+        return INVALID_PARAMETER;
+    }
+
+    memset(out_slab, 0, sizeof(slab_allocator));
+    out_slab->backing = backing;
+    out_slab->slab_bytes = slab_bytes;
+    while(((size_t) 1 << out_slab->slab_bits) < slab_bytes) out_slab->slab_bits++;
+    out_slab->log_function = log_function;
+
+    /* slots only pay off up to half a page, beyond that page allocations round up less */
+    for(uint32_t k = 0; k < SLAB_MAX_CLASSES && slab_slot_sizes[k] <= backing[0].page_size / 2; k++) {
+        uint32_t slot_size = slab_slot_sizes[k];
+        /* the bitmap only shrinks as slots are given up for it, so this settles quickly */
+        uint32_t slots = (uint32_t) ((slab_bytes - 64) / slot_size);
+        uint32_t offset;
+        for(;;) {
+            offset = (uint32_t) ((sizeof(slab_header) + ((slots + 63) / 64)*sizeof(uint64_t) + 63) / 64) * 64;
+            if(offset + (size_t) slots*slot_size <= slab_bytes) break;
+            slots = (uint32_t) ((slab_bytes - offset) / slot_size);
+        }
+        out_slab->slot_sizes[k] = slot_size;
+        out_slab->slots_per_slab[k] = slots;
+        out_slab->first_slot_offset[k] = offset;
+        out_slab->class_count = k + 1;
+    }
+
+    if(log_function != NULL) log_function(INITIALIZATION_SUCCESS, "Successfully initialized the slab allocator");
+    return SUCCESS;
+}
+
+alloc_result deinit_slab_allocator(slab_allocator* p_slab) {
+    if(p_slab == NULL) {
+        return INVALID_PARAMETER;
+    }
+    PFN_alloc_log log_function = p_slab->log_function;
+
+    /* full slabs are on no list, so the slabs are found through the map */
+    alloc_result result = SUCCESS;
+    for(size_t word = 0; word < ((size_t) p_slab->map_pages + 63) / 64; word++) {
+        for(size_t bit = 0; bit < 64 && p_slab->slab_map[word] != 0; bit++) {
+            if(((p_slab->slab_map[word] >> bit) & 1) == 0) continue;
+            void* slab = &(p_slab->backing[0].data[(word*64 + bit)*p_slab->backing[0].page_size]);
+            if(free_size(p_slab->backing, slab, p_slab->slab_bytes) != SUCCESS) result = ERROR_UNKNOWN;
+        }
+    }
+    free(p_slab->slab_map);
+    memset(p_slab, 0, sizeof(slab_allocator));
+
+    if(log_function != NULL) log_function(result == SUCCESS ? DEINITIALIZATION_SUCCESS : DEINITIALIZATION_ERROR, "Deinitialized the slab allocator");
+    return result;
+}
+
+alloc_result slab_get_size(const slab_allocator* p_slab, void* ptr, size_t* size) {
+    if(p_slab == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(ptr == NULL || size == NULL) {
+        if(p_slab->log_function != NULL) p_slab->log_function(SIZE_ERROR, "Pointer or out-pointer to store size is NULL!");
+        return INVALID_PARAMETER;
+    }
+    slab_header *slab = owning_slab(p_slab, ptr);
+    if(slab == NULL) return get_size(p_slab->backing, ptr, size);
+
+    uint32_t index;
+    alloc_result validate_result = validate_slot(p_slab, slab, ptr, 0, SIZE_ERROR, &index);
+    if(validate_result != SUCCESS) return validate_result;
+    size[0] = slab->slot_size;
+    return SUCCESS;
+}
+
+alloc_result slab_alloc_align_offset_zeroable(slab_allocator* p_slab, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr) {
+    if(p_slab == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(size == 0 || out_ptr == NULL) {
+        if(p_slab->log_function != NULL) p_slab->log_function(ALLOCATION_ERROR, "Attempt to allocate 0 bytes or without out-pointer!");
+        return INVALID_PARAMETER;
+    }
+    uint32_t size_class = class_for_size(p_slab, size, alignment_bits, offset_to_alignment);
+    if(size_class == p_slab->class_count) return alloc_align_offset_zeroable(p_slab->backing, size, alignment_bits, offset_to_alignment, zeroed, out_ptr);
+    return alloc_slot(p_slab, size_class, zeroed, out_ptr);
+}
+
+alloc_result slab_resize_oldsize_zeroable(slab_allocator* p_slab, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr) {
+    if(p_slab == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(old_ptr == NULL || new_ptr == NULL || new_size == 0) {
+        if(p_slab->log_function != NULL) p_slab->log_function(REALLOCATION_ERROR, "Pointer or out-pointer is NULL, or attempt to resize to 0 bytes!");
+        return INVALID_PARAMETER;
+    }
+    slab_header *slab = owning_slab(p_slab, old_ptr);
+    uint32_t new_class = class_for_size(p_slab, new_size, alignment_bits, offset_to_alignment);
+    if(slab == NULL && new_class == p_slab->class_count) {
+        return resize_oldsize_zeroable(p_slab->backing, old_ptr, old_size, new_size, alignment_bits, offset_to_alignment, true, zero_new_pages, new_ptr);
+    }
+
+    size_t old_bytes;
+    uint32_t index = 0;
+    if(slab != NULL) {
+        alloc_result validate_result = validate_slot(p_slab, slab, old_ptr, old_size, REALLOCATION_ERROR, &index);
+        if(validate_result != SUCCESS) return validate_result;
+        old_bytes = slab->slot_size;
+        if(new_class == slab->size_class) {
+            /* the slot is kept, only the bytes beyond the old size may have to be zeroed */
+            if(zero_new_pages && old_size != 0 && old_size != NO_OLD_SIZE_DATA && new_size > old_size) memset(&(((uint8_t*) old_ptr)[old_size]), 0, new_size - old_size);
+            new_ptr[0] = old_ptr;
+            return SUCCESS;
+        }
+    } else {
+        alloc_result size_result = get_size(p_slab->backing, old_ptr, &old_bytes);
+        if(size_result != SUCCESS) return size_result;
+    }
+
+    /* moving between slots of different classes, or between a slot and pages */
+    void* moved_ptr;
+    alloc_result alloc_result_new = slab_alloc_align_offset_zeroable(p_slab, new_size, alignment_bits, offset_to_alignment, zero_new_pages, &moved_ptr);
+    if(alloc_result_new != SUCCESS) return alloc_result_new;
+    memcpy(moved_ptr, old_ptr, (old_bytes < new_size) ? old_bytes : new_size);
+    alloc_result free_result = (slab != NULL) ? free_slot(p_slab, slab, index) : free_size(p_slab->backing, old_ptr, old_size);
+    if(free_result != SUCCESS) return free_result;
+
+    new_ptr[0] = moved_ptr;
+    return SUCCESS;
+}
+
+alloc_result slab_free_size(slab_allocator* p_slab, void* ptr, size_t old_size) {
+    if(p_slab == NULL) {
+        return INVALID_PARAMETER;
+    }
+    if(ptr == NULL) {
+        if(p_slab->log_function != NULL) p_slab->log_function(DEALLOCATION_ERROR, "Pointer to be freed is NULL!");
+        return INVALID_PARAMETER;
+    }
+    slab_header *slab = owning_slab(p_slab, ptr);
+    if(slab == NULL) return free_size(p_slab->backing, ptr, old_size);
+
+    uint32_t index;
+    alloc_result validate_result = validate_slot(p_slab, slab, ptr, old_size, DEALLOCATION_ERROR, &index);
+    if(validate_result != SUCCESS) return validate_result;
+    return free_slot(p_slab, slab, index);
+}
@@ -0,0 +1,54 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "alloc.h"
+
+/* A slab layer for objects smaller than a page, on top of an existing allocator.
+
+   Slabs are allocations of slab_bytes (a power of two) from the backing allocator, aligned to
+   slab_bytes, that are carved into slots of one size class each. A slab starts with a header
+   (slot size first), followed by a bitmap of the slots in use and the slots themselves. Free slots
+   form a list threaded through them, so allocating and freeing a slot is O(1); the slab of a
+   pointer is found by masking off the low address bits and checking a bitmap over the backing
+   pages that marks where slabs start.
+
+   Requests that don't fit any slot class (or ask for more alignment than the slots give) are
+   passed on to the backing allocator, so the slab_* functions can stand in for the plain ones.
+   Like a plain allocator, a slab allocator must not be used from several threads at once, and
+   the backing allocator must keep its data in place (BACKEND_MMAP, or no expansion).
+*/
+
+#define SLAB_MAX_CLASSES 16
+#define SLAB_DEFAULT_BYTES (64*1024)
+
+struct slab_header;
+
+typedef struct slab_allocator {
+    allocator *backing;
+    size_t slab_bytes;
+    int slab_bits;
+    uint32_t class_count;
+    uint32_t slot_sizes[SLAB_MAX_CLASSES];          /* ascending, all at most half a page of the backing allocator */
+    uint32_t slots_per_slab[SLAB_MAX_CLASSES];
+    uint32_t first_slot_offset[SLAB_MAX_CLASSES];   /* header and bitmap, rounded up to 64 bytes */
+    struct slab_header *partial[SLAB_MAX_CLASSES];  /* slabs of each class with at least one free slot */
+    uint64_t *slab_map;     /* one bit per backing page, set where a slab starts */
+    uint32_t map_pages;     /* pages covered by slab_map */
+    uint32_t slab_count;    /* slabs currently taken from the backing allocator */
+    PFN_alloc_log log_function;
+} slab_allocator;
+
+
+/* slab_bytes must be a power of two of at least 1 KiB and a page of the backing allocator, 0 selects SLAB_DEFAULT_BYTES */
+alloc_result init_slab_allocator(allocator* backing, size_t slab_bytes, PFN_alloc_log log_function, slab_allocator* out_slab);
+/* gives all slabs back to the backing allocator; allocations passed through to it stay valid */
+alloc_result deinit_slab_allocator(slab_allocator* p_slab);
+
+/* slot size for pointers to slots, otherwise the size reported by the backing allocator */
+alloc_result slab_get_size(const slab_allocator* p_slab, void* ptr, size_t* size);
+alloc_result slab_alloc_align_offset_zeroable(slab_allocator* p_slab, size_t size, int alignment_bits, size_t offset_to_alignment, bool zeroed, void** out_ptr);
+/* stays in the slot if the new size still belongs to its class, and moves between slots and pages otherwise */
+alloc_result slab_resize_oldsize_zeroable(slab_allocator* p_slab, void* old_ptr, size_t old_size, size_t new_size, int alignment_bits, size_t offset_to_alignment, bool zero_new_pages, void** new_ptr);
+alloc_result slab_free_size(slab_allocator* p_slab, void* ptr, size_t old_size);
+
+#endif
@@ -0,0 +1,185 @@
+/* Turns a trace dump (see dump_allocator_trace, built with ALLOC_TRACE) into a replayable trace and latency histograms.
+
+   usage: alloc_trace_decode <dump> [<replay>]
+
+   The replay file has one line per successful call, with allocations named by ids instead of pages:
+
+       # page_size <bytes>
+       a <id> <size> <alignment_bits> <zeroed>    allocation
+       r <id> <size> <alignment_bits> <zeroed>    resize
+       f <id>                                     free
+
+   An allocation that was made before the oldest record in the dump gets an 'a' line (of its page count) where it
+   first shows up; relocations only rename pages and leave no line. On stdout go a summary per operation (calls,
+   failures, latency percentiles, mean PAT pages scanned) and a histogram of the latencies in powers of two of ns,
+   both as CSV.
+
+   build: cc -O2 -I.. alloc_trace_decode.c -o alloc_trace_decode
+*/
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPS 4
+#define BUCKETS 48
+
+static const char* op_names[OPS] = { "alloc", "resize", "free", "relocate" };
+
+typedef struct op_summary {
+    uint64_t *durations;
+    size_t count;
+    size_t capacity;
+    size_t failed;
+    uint64_t pages_scanned;
+    uint64_t buckets[BUCKETS];
+} op_summary;
+
+static uint64_t *page_ids;  /* id + 1 of the live allocation starting at each page, 0 if none is known */
+static size_t page_capacity;
+static uint64_t next_id = 1;
+
+static uint64_t* page_slot(uint32_t page) {
+    if(page >= page_capacity) {
+        size_t capacity = (page_capacity == 0) ? 4096 : page_capacity;
+        while(capacity <= page) capacity *= 2;
+        page_ids = realloc(page_ids, capacity*sizeof(uint64_t));
+        if(page_ids == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        memset(&(page_ids[page_capacity]), 0, (capacity - page_capacity)*sizeof(uint64_t));
+        page_capacity = capacity;
+    }
+    return &(page_ids[page]);
+}
+
+/* the id of the allocation at old_page, made up with an 'a' line if it predates the dump */
+static uint64_t known_id(FILE *replay, const alloc_trace_record *record, uint32_t page_size) {
+    uint64_t *slot = page_slot(record->old_page);
+    if(slot[0] == 0) {
+        slot[0] = next_id++;
+        if(replay != NULL) fprintf(replay, "a %llu %llu 0 0\n", (unsigned long long) slot[0] - 1, (unsigned long long) record->old_pages*page_size);
+    }
+    return slot[0] - 1;
+}
+
+static void replay_record(FILE *replay, const alloc_trace_record *record, uint32_t page_size) {
+    if(record->result != SUCCESS) return;
+    switch(record->op) {
+        case TRACE_ALLOC: {
+            uint64_t *slot = page_slot(record->page);
+            /* concurrent callers can record a free after the allocation that reused its pages */
+            if(slot[0] != 0 && replay != NULL) fprintf(replay, "f %llu\n", (unsigned long long) slot[0] - 1);
+            slot[0] = next_id++;
+            if(replay != NULL) fprintf(replay, "a %llu %llu %u %u\n", (unsigned long long) slot[0] - 1, (unsigned long long) record->size, record->alignment_bits, record->zeroed);
+            break;
+        }
+        case TRACE_RESIZE:
+        case TRACE_RELOCATE: {
+            uint64_t id = known_id(replay, record, page_size);
+            page_slot(record->old_page)[0] = 0;
+            page_slot(record->page)[0] = id + 1;
+            if(record->op == TRACE_RESIZE && replay != NULL) fprintf(replay, "r %llu %llu %u %u\n", (unsigned long long) id, (unsigned long long) record->size, record->alignment_bits, record->zeroed);
+            break;
+        }
+        case TRACE_FREE: {
+            uint64_t *slot = page_slot(record->old_page);
+            if(slot[0] != 0 && replay != NULL) fprintf(replay, "f %llu\n", (unsigned long long) slot[0] - 1);
+            slot[0] = 0;
+            break;
+        }
+    }
+}
+
+static void summarize_record(op_summary *summaries, const alloc_trace_record *record) {
+    op_summary *summary = &(summaries[record->op]);
+    if(summary->count == summary->capacity) {
+        summary->capacity = (summary->capacity == 0) ? 4096 : summary->capacity*2;
+        summary->durations = realloc(summary->durations, summary->capacity*sizeof(uint64_t));
+        if(summary->durations == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    summary->durations[summary->count++] = record->duration_ns;
+    if(record->result != SUCCESS) summary->failed++;
+    summary->pages_scanned += record->pages_scanned;
+    int bucket = 0;
+    while(bucket + 1 < BUCKETS && ((uint64_t) 1 << bucket) < record->duration_ns) bucket++;
+    summary->buckets[bucket]++;
+}
+
+static int compare_durations(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const op_summary *summary, double fraction) {
+    size_t k = (size_t) (fraction * (double) (summary->count - 1));
+    return summary->durations[k];
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <dump> [<replay>]\n", argv[0]);
+        return 1;
+    }
+    FILE *dump = fopen(argv[1], "rb");
+    if(dump == NULL) {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 1;
+    }
+    alloc_trace_header header;
+    if(fread(&header, sizeof(header), 1, dump) != 1 || memcmp(header.magic, ALLOC_TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.record_bytes != sizeof(alloc_trace_record)) {
+        fprintf(stderr, "%s is no trace dump of this version\n", argv[1]);
+        return 1;
+    }
+    FILE *replay = NULL;
+    if(argc > 2) {
+        replay = fopen(argv[2], "w");
+        if(replay == NULL) {
+            fprintf(stderr, "could not open %s\n", argv[2]);
+            return 1;
+        }
+        fprintf(replay, "# page_size %u\n", header.page_size);
+    }
+
+    op_summary summaries[OPS];
+    memset(summaries, 0, sizeof(summaries));
+    alloc_trace_record record;
+    uint64_t read = 0;
+    while(read < header.record_count && fread(&record, sizeof(record), 1, dump) == 1) {
+        read++;
+        if(record.op >= OPS) continue;
+        summarize_record(summaries, &record);
+        replay_record(replay, &record, header.page_size);
+    }
+    fclose(dump);
+    if(replay != NULL) fclose(replay);
+    if(read != header.record_count) fprintf(stderr, "the dump ends after %llu of %llu records\n", (unsigned long long) read, (unsigned long long) header.record_count);
+    if(header.lost_records != 0) fprintf(stderr, "%llu records were lost before the dump\n", (unsigned long long) header.lost_records);
+
+    printf("op,calls,failed,p50_ns,p99_ns,p999_ns,max_ns,mean_pages_scanned\n");
+    for(int op = 0; op < OPS; op++) {
+        op_summary *summary = &(summaries[op]);
+        if(summary->count == 0) continue;
+        qsort(summary->durations, summary->count, sizeof(uint64_t), compare_durations);
+        printf("%s,%zu,%zu,%llu,%llu,%llu,%llu,%.1f\n", op_names[op], summary->count, summary->failed,
+            (unsigned long long) percentile(summary, 0.5), (unsigned long long) percentile(summary, 0.99),
+            (unsigned long long) percentile(summary, 0.999), (unsigned long long) summary->durations[summary->count - 1],
+            (double) summary->pages_scanned / summary->count);
+    }
+    printf("\nop,duration_up_to_ns,calls\n");
+    for(int op = 0; op < OPS; op++) {
+        for(int bucket = 0; bucket < BUCKETS; bucket++) {
+            if(summaries[op].buckets[bucket] != 0) printf("%s,%llu,%llu\n", op_names[op], 1ULL << bucket, (unsigned long long) summaries[op].buckets[bucket]);
+        }
+        free(summaries[op].durations);
+    }
+    free(page_ids);
+    return 0;
+}